@@ -186,6 +186,10 @@ cpu_tb_exec(CPUState *cpu, TranslationBlock *itb, int *tb_exit)
     }
 #endif /* DEBUG_DISAS */
 
+#ifdef CONFIG_PROFILER
+    qatomic_set(&itb->exec_count, itb->exec_count + 1);
+#endif
+
     qemu_thread_jit_execute();
     ret = tcg_qemu_tb_exec(env, tb_ptr);
     cpu->can_do_io = 1;
@@ -256,8 +260,11 @@ void cpu_exec_step_atomic(CPUState *cpu)
         g_assert(cpu == current_cpu);
         g_assert(!cpu->running);
         cpu->running = true;
+        qatomic_set(&tb_ctx.exclusive_step_count,
+                    tb_ctx.exclusive_step_count + 1);
 
         cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+        trace_exec_step_atomic(cpu->cpu_index, pc);
         tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
 
         if (tb == NULL) {
@@ -429,7 +436,7 @@ static inline TranslationBlock *tb_find(CPUState *cpu,
         tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
         mmap_unlock();
         /* We add the TB in the virtual pc hash table for the fast lookup */
-        qatomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)], tb);
+        tb_jmp_cache_set(cpu, pc, tb);
     }
 #ifndef CONFIG_USER_ONLY
     /* We don't take care of direct jumps when address mapping changes in
@@ -81,6 +81,10 @@ QEMU_BUILD_BUG_ON(sizeof(target_ulong) > sizeof(run_on_cpu_data));
 QEMU_BUILD_BUG_ON(NB_MMU_MODES > 16);
 #define ALL_MMUIDX_BITS ((1 << NB_MMU_MODES) - 1)
 
+/* CPUTLBDesc.vused is a bitmap of the victim tlb sets. */
+QEMU_BUILD_BUG_ON(CPU_VTLB_SETS > 32);
+#define ALL_VTLB_SETS_BITS ((uint32_t)MAKE_64BIT_MASK(0, CPU_VTLB_SETS))
+
 static inline size_t tlb_n_entries(CPUTLBDescFast *fast)
 {
     return (fast->mask >> CPU_TLB_ENTRY_BITS) + 1;
@@ -103,7 +107,7 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
     unsigned int i, i0 = tb_jmp_cache_hash_page(page_addr);
 
     for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i0 + i], NULL);
+        qatomic_set(&cpu->tb_jmp_cache[i0 + i].tb, NULL);
     }
 }
 
@@ -232,12 +236,23 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
 
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
+    uint32_t vused = desc->vused;
+
     desc->n_used_entries = 0;
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
-    desc->vindex = 0;
+    desc->large_page_max_mask = -1;
     memset(fast->table, -1, sizeof_tlb(fast));
-    memset(desc->vtable, -1, sizeof(desc->vtable));
+
+    /* Only clear the victim tlb sets that have been filled.  */
+    while (vused) {
+        int set = ctz32(vused);
+
+        memset(&desc->vtable[set * CPU_VTLB_WAYS], -1,
+               sizeof(CPUTLBEntry) * CPU_VTLB_WAYS);
+        vused &= vused - 1;
+    }
+    desc->vused = 0;
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUArchState *env, int mmu_idx,
@@ -259,6 +274,7 @@ static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now)
     fast->mask = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
     fast->table = g_new(CPUTLBEntry, n_entries);
     desc->iotlb = g_new(CPUIOTLBEntry, n_entries);
+    desc->vused = ALL_VTLB_SETS_BITS;
     tlb_mmu_flush_locked(desc, fast);
 }
 
@@ -339,6 +355,14 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+void tlb_victim_counts(CPUState *cpu, size_t *phit, size_t *pmiss)
+{
+    CPUArchState *env = cpu->env_ptr;
+
+    *phit = qatomic_read(&env_tlb(env)->c.vtlb_hit_count);
+    *pmiss = qatomic_read(&env_tlb(env)->c.vtlb_miss_count);
+}
+
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     CPUArchState *env = cpu->env_ptr;
@@ -471,17 +495,45 @@ static inline bool tlb_flush_entry_locked(CPUTLBEntry *tlb_entry,
     return tlb_flush_entry_mask_locked(tlb_entry, page, -1);
 }
 
+/* Return the page mapped by the non-empty entry @te.  */
+static target_ulong tlb_entry_page(const CPUTLBEntry *te)
+{
+    target_ulong addr = te->addr_read;
+
+    if (addr == -1) {
+        addr = tlb_addr_write(te);
+    }
+    if (addr == -1) {
+        addr = te->addr_code;
+    }
+    return addr & TARGET_PAGE_MASK;
+}
+
+/* Return the victim tlb set that holds @page.  */
+static inline size_t vtlb_set(target_ulong page)
+{
+    uint64_t vpn = page >> TARGET_PAGE_BITS;
+
+    return (vpn * 0x9e3779b97f4a7c15ull) >> (64 - CPU_VTLB_SET_BITS);
+}
+
 /* Called with tlb_c.lock held */
 static void tlb_flush_vtlb_page_mask_locked(CPUArchState *env, int mmu_idx,
                                             target_ulong page,
                                             target_ulong mask)
 {
     CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
-    int k;
+    int k, first = 0, last = CPU_VTLB_SIZE;
 
     assert_cpu_is_self(env_cpu(env));
-    for (k = 0; k < CPU_VTLB_SIZE; k++) {
-        if (tlb_flush_entry_mask_locked(&d->vtable[k], page, mask)) {
+    if (mask == -1) {
+        /* A single page can only be present in its own set.  */
+        first = vtlb_set(page) * CPU_VTLB_WAYS;
+        last = first + CPU_VTLB_WAYS;
+    }
+    for (k = first; k < last; k++) {
+        if (!tlb_entry_is_empty(&d->vtable[k])
+            && tlb_flush_entry_mask_locked(&d->vtable[k], page, mask)) {
             tlb_n_used_entries_dec(env, mmu_idx);
         }
     }
@@ -493,6 +545,39 @@ static inline void tlb_flush_vtlb_page_locked(CPUArchState *env, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(env, mmu_idx, page, -1);
 }
 
+/*
+ * Flush any large page that may contain @page, comparing addresses
+ * under @mask.  We do not know which page size maps @page, but it
+ * cannot be larger than the largest page in the tlb, so flush every
+ * entry within that naturally aligned block instead of the entire tlb.
+ * Entries outside the block, including other large pages, are kept,
+ * and so is the large page region.
+ * Called with tlb_c.lock held.
+ */
+static void tlb_flush_large_page_locked(CPUArchState *env, int midx,
+                                        target_ulong page, target_ulong mask)
+{
+    CPUTLBDescFast *f = &env_tlb(env)->f[midx];
+    size_t i, n = tlb_n_entries(f);
+
+    /* Keep TLB_INVALID_MASK so that empty entries never match. */
+    mask &= env_tlb(env)->d[midx].large_page_max_mask | TLB_INVALID_MASK;
+
+    tlb_debug("flush large page midx %d (" TARGET_FMT_lx "/" TARGET_FMT_lx
+              ")\n", midx, page & mask, mask);
+
+    page &= mask;
+    for (i = 0; i < n; i++) {
+        CPUTLBEntry *entry = &f->table[i];
+
+        if (!tlb_entry_is_empty(entry)
+            && tlb_flush_entry_mask_locked(entry, page, mask)) {
+            tlb_n_used_entries_dec(env, midx);
+        }
+    }
+    tlb_flush_vtlb_page_mask_locked(env, midx, page, mask);
+}
+
 static void tlb_flush_page_locked(CPUArchState *env, int midx,
                                   target_ulong page)
 {
@@ -501,10 +586,7 @@ static void tlb_flush_page_locked(CPUArchState *env, int midx,
 
     /* Check if we need to flush due to large pages.  */
     if ((page & lp_mask) == lp_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
+        tlb_flush_large_page_locked(env, midx, page, -1);
     } else {
         if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
             tlb_n_used_entries_dec(env, midx);
@@ -739,6 +821,13 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
      * we only need to test the end of the range.
      */
     if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr) {
+        target_ulong max_mask = d->large_page_max_mask;
+
+        if ((addr & max_mask) == ((addr + len - 1) & max_mask)) {
+            /* The whole range lies within one block of the largest size. */
+            tlb_flush_large_page_locked(env, midx, addr, mask);
+            return;
+        }
         tlb_debug("forcing full flush midx %d ("
                   TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
                   midx, d->large_page_addr, d->large_page_mask);
@@ -999,6 +1088,22 @@ static inline void copy_tlb_helper_locked(CPUTLBEntry *d, const CPUTLBEntry *s)
     *d = *s;
 }
 
+/*
+ * Insert @te and its iotlb entry @io into the victim tlb, replacing
+ * the ways of its set in round-robin order.
+ * Called with tlb_c.lock held.
+ */
+static void tlb_vtlb_insert_locked(CPUTLBDesc *desc, const CPUTLBEntry *te,
+                                   const CPUIOTLBEntry *io)
+{
+    size_t set = vtlb_set(tlb_entry_page(te));
+    size_t vidx = set * CPU_VTLB_WAYS + desc->vindex[set]++ % CPU_VTLB_WAYS;
+
+    copy_tlb_helper_locked(&desc->vtable[vidx], te);
+    desc->viotlb[vidx] = *io;
+    desc->vused |= 1u << set;
+}
+
 /* This is a cross vCPU call (i.e. another vCPU resetting the flags of
  * the target vCPU).
  * We must take tlb_c.lock to avoid racing with another vCPU update. The only
@@ -1084,6 +1189,7 @@ static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
     }
     env_tlb(env)->d[mmu_idx].large_page_addr = lp_addr & lp_mask;
     env_tlb(env)->d[mmu_idx].large_page_mask = lp_mask;
+    env_tlb(env)->d[mmu_idx].large_page_max_mask &= ~(size - 1);
 }
 
 /* Add a new TLB entry. At most one entry for a given virtual address
@@ -1205,12 +1311,8 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
      * different page; otherwise just overwrite the stale data.
      */
     if (!tlb_hit_page_anyprot(te, vaddr_page) && !tlb_entry_is_empty(te)) {
-        unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
-        CPUTLBEntry *tv = &desc->vtable[vidx];
-
         /* Evict the old entry into the victim tlb.  */
-        copy_tlb_helper_locked(tv, te);
-        desc->viotlb[vidx] = desc->iotlb[index];
+        tlb_vtlb_insert_locked(desc, te, &desc->iotlb[index]);
         tlb_n_used_entries_dec(env, mmu_idx);
     }
 
@@ -1447,11 +1549,14 @@ static inline target_ulong tlb_read_ofs(CPUTLBEntry *entry, size_t ofs)
 static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
                            size_t elt_ofs, target_ulong page)
 {
+    CPUTLB *tlb = env_tlb(env);
+    CPUTLBDesc *desc = &tlb->d[mmu_idx];
+    size_t set = vtlb_set(page);
     size_t vidx;
 
     assert_cpu_is_self(env_cpu(env));
-    for (vidx = 0; vidx < CPU_VTLB_SIZE; ++vidx) {
-        CPUTLBEntry *vtlb = &env_tlb(env)->d[mmu_idx].vtable[vidx];
+    for (vidx = set * CPU_VTLB_WAYS; vidx < (set + 1) * CPU_VTLB_WAYS; ++vidx) {
+        CPUTLBEntry *vtlb = &desc->vtable[vidx];
         target_ulong cmp;
 
         /* elt_ofs might correspond to .addr_write, so use qatomic_read */
@@ -1463,20 +1568,31 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
 
         if (cmp == page) {
             /* Found entry in victim tlb, swap tlb and iotlb.  */
-            CPUTLBEntry tmptlb, *tlb = &env_tlb(env)->f[mmu_idx].table[index];
-
-            qemu_spin_lock(&env_tlb(env)->c.lock);
-            copy_tlb_helper_locked(&tmptlb, tlb);
-            copy_tlb_helper_locked(tlb, vtlb);
-            copy_tlb_helper_locked(vtlb, &tmptlb);
-            qemu_spin_unlock(&env_tlb(env)->c.lock);
+            CPUTLBEntry tmptlb, *te = &tlb->f[mmu_idx].table[index];
+            CPUIOTLBEntry tmpio, *io = &desc->iotlb[index];
+            CPUIOTLBEntry *vio = &desc->viotlb[vidx];
+
+            qemu_spin_lock(&tlb->c.lock);
+            copy_tlb_helper_locked(&tmptlb, te);
+            copy_tlb_helper_locked(te, vtlb);
+            tmpio = *io;
+            *io = *vio;
+            if (tlb_entry_is_empty(&tmptlb)
+                || vtlb_set(tlb_entry_page(&tmptlb)) == set) {
+                copy_tlb_helper_locked(vtlb, &tmptlb);
+                *vio = tmpio;
+            } else {
+                /* The displaced entry belongs to a different set.  */
+                memset(vtlb, -1, sizeof(*vtlb));
+                tlb_vtlb_insert_locked(desc, &tmptlb, &tmpio);
+            }
+            qemu_spin_unlock(&tlb->c.lock);
 
-            CPUIOTLBEntry tmpio, *io = &env_tlb(env)->d[mmu_idx].iotlb[index];
-            CPUIOTLBEntry *vio = &env_tlb(env)->d[mmu_idx].viotlb[vidx];
-            tmpio = *io; *io = *vio; *vio = tmpio;
+            qatomic_set(&tlb->c.vtlb_hit_count, tlb->c.vtlb_hit_count + 1);
             return true;
         }
     }
+    qatomic_set(&tlb->c.vtlb_miss_count, tlb->c.vtlb_miss_count + 1);
     return false;
 }
 
@@ -19,4 +19,6 @@ void QEMU_NORETURN cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 void page_init(void);
 void tb_htable_init(void);
 
+extern bool tb_evict_enabled;
+
 #endif /* ACCEL_TCG_INTERNAL_H */
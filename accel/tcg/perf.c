@@ -0,0 +1,74 @@
+/*
+ * Linux perf perf-<pid>.map support.
+ *
+ * perf looks up samples that hit anonymous executable memory in
+ * /tmp/perf-<pid>.map, a text file with one "START SIZE NAME" line per
+ * symbol. Writing one line per TB lets host-side profiles attribute
+ * time spent in the code_gen_buffer to the guest code it came from.
+ *
+ * Host addresses are reused after a TB flush; perf then attributes
+ * samples to whichever line it finds first, so profiles of guests
+ * that flush often should be read with that in mind.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "disas/disas.h"
+#include "tcg/tcg.h"
+#include "perf.h"
+
+static FILE *perfmap;
+
+void perf_enable_perfmap(void)
+{
+    g_autofree char *path = NULL;
+
+    if (perfmap) {
+        return;
+    }
+
+    path = g_strdup_printf("/tmp/perf-%d.map", getpid());
+    perfmap = fopen(path, "w");
+    if (perfmap == NULL) {
+        warn_report("Could not open %s: %s, proceeding without perfmap",
+                    path, strerror(errno));
+    }
+}
+
+void perf_report_code(const TranslationBlock *tb)
+{
+    const char *symbol;
+
+    if (!perfmap) {
+        return;
+    }
+
+    /*
+     * Translation may happen on several threads at once, but each line
+     * goes out with a single stdio call, which locks the stream.
+     */
+    symbol = lookup_symbol(tb->pc);
+    if (symbol[0]) {
+        fprintf(perfmap, "%" PRIxPTR " %zx %s [guest 0x"
+                TARGET_FMT_lx "]\n", (uintptr_t)tb->tc.ptr, tb->tc.size,
+                symbol, tb->pc);
+    } else {
+        fprintf(perfmap, "%" PRIxPTR " %zx guest 0x"
+                TARGET_FMT_lx "\n", (uintptr_t)tb->tc.ptr, tb->tc.size,
+                tb->pc);
+    }
+}
+
+void perf_exit(void)
+{
+    /*
+     * Other vCPU threads may still be translating, so only flush: the
+     * stream is closed by the C library if we exit normally, and
+     * _exit() would otherwise lose whatever is still buffered.
+     */
+    if (perfmap) {
+        fflush(perfmap);
+    }
+}
@@ -0,0 +1,21 @@
+/*
+ * Linux perf perf-<pid>.map support.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_PERF_H
+#define ACCEL_TCG_PERF_H
+
+#include "exec/exec-all.h"
+
+/* Start writing perf-<pid>.map. */
+void perf_enable_perfmap(void);
+
+/* Add information about TCG-generated code to the map file. */
+void perf_report_code(const TranslationBlock *tb);
+
+/* Flush the map file before exiting; a no-op if it was never opened. */
+void perf_exit(void);
+
+#endif
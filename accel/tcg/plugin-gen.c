@@ -125,20 +125,12 @@ static void gen_empty_udata_cb(void)
 }
 
 /*
- * For now we only support addi_i64.
- * When we support more ops, we can generate one empty inline cb for each.
+ * Inline ops and conditional callbacks are not copied from a template;
+ * they are emitted directly in place of this empty marker, see
+ * inject_inline_cb().
  */
 static void gen_empty_inline_cb(void)
 {
-    TCGv_i64 val = tcg_temp_new_i64();
-    TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
-
-    tcg_gen_ld_i64(val, ptr, 0);
-    /* pass an immediate != 0 so that it doesn't get optimized away */
-    tcg_gen_addi_i64(val, val, 0xdeadface);
-    tcg_gen_st_i64(val, ptr, 0);
-    tcg_temp_free_ptr(ptr);
-    tcg_temp_free_i64(val);
 }
 
 static void gen_empty_mem_cb(TCGv addr, uint32_t info)
@@ -330,19 +322,6 @@ static TCGOp *copy_extu_tl_i64(TCGOp **begin_op, TCGOp *op)
     return op;
 }
 
-static TCGOp *copy_ld_i64(TCGOp **begin_op, TCGOp *op)
-{
-    if (TCG_TARGET_REG_BITS == 32) {
-        /* 2x ld_i32 */
-        op = copy_op(begin_op, op, INDEX_op_ld_i32);
-        op = copy_op(begin_op, op, INDEX_op_ld_i32);
-    } else {
-        /* ld_i64 */
-        op = copy_op(begin_op, op, INDEX_op_ld_i64);
-    }
-    return op;
-}
-
 static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op)
 {
     if (TCG_TARGET_REG_BITS == 32) {
@@ -356,21 +335,6 @@ static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op)
     return op;
 }
 
-static TCGOp *copy_add_i64(TCGOp **begin_op, TCGOp *op, uint64_t v)
-{
-    if (TCG_TARGET_REG_BITS == 32) {
-        /* all 32-bit backends must implement add2_i32 */
-        g_assert(TCG_TARGET_HAS_add2_i32);
-        op = copy_op(begin_op, op, INDEX_op_add2_i32);
-        op->args[4] = tcgv_i32_arg(tcg_constant_i32(v));
-        op->args[5] = tcgv_i32_arg(tcg_constant_i32(v >> 32));
-    } else {
-        op = copy_op(begin_op, op, INDEX_op_add_i64);
-        op->args[2] = tcgv_i64_arg(tcg_constant_i64(v));
-    }
-    return op;
-}
-
 static TCGOp *copy_st_ptr(TCGOp **begin_op, TCGOp *op)
 {
     if (UINTPTR_MAX == UINT32_MAX) {
@@ -443,25 +407,6 @@ static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
-static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
-                               TCGOp *begin_op, TCGOp *op,
-                               int *unused)
-{
-    /* const_ptr */
-    op = copy_const_ptr(&begin_op, op, cb->userp);
-
-    /* ld_i64 */
-    op = copy_ld_i64(&begin_op, op);
-
-    /* add_i64 */
-    op = copy_add_i64(&begin_op, op, cb->inline_insn.imm);
-
-    /* st_i64 */
-    op = copy_st_i64(&begin_op, op);
-
-    return op;
-}
-
 static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
                             TCGOp *begin_op, TCGOp *op, int *cb_idx)
 {
@@ -547,10 +492,158 @@ inject_udata_cb(const GArray *cbs, TCGOp *begin_op)
     inject_cb_type(cbs, begin_op, append_udata_cb, op_ok);
 }
 
-static void
-inject_inline_cb(const GArray *cbs, TCGOp *begin_op, op_ok_fn ok)
+/*
+ * Compute the address of @entry for the executing vCPU:
+ * the address for vCPU 0 plus cpu_index * element size.
+ */
+static TCGv_ptr gen_plugin_u64_ptr(qemu_plugin_u64 entry)
+{
+    TCGv_ptr ptr = tcg_temp_new_ptr();
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    size_t entry_size = g_array_get_element_size(entry.score->data);
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    tcg_gen_muli_i32(cpu_index, cpu_index, entry_size);
+    tcg_gen_ext_i32_ptr(ptr, cpu_index);
+    tcg_gen_addi_ptr(ptr, ptr, (intptr_t)plugin_u64_address(entry, 0));
+    tcg_temp_free_i32(cpu_index);
+    return ptr;
+}
+
+static void gen_inline_op(const struct qemu_plugin_dyn_cb *cb)
+{
+    TCGv_i64 val = tcg_temp_new_i64();
+    TCGv_ptr ptr;
+
+    if (cb->inline_insn.entry.score) {
+        ptr = gen_plugin_u64_ptr(cb->inline_insn.entry);
+    } else {
+        ptr = tcg_const_ptr(cb->userp);
+    }
+
+    switch (cb->inline_insn.op) {
+    case QEMU_PLUGIN_INLINE_ADD_U64:
+        tcg_gen_ld_i64(val, ptr, 0);
+        tcg_gen_addi_i64(val, val, cb->inline_insn.imm);
+        break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        tcg_gen_movi_i64(val, cb->inline_insn.imm);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    tcg_gen_st_i64(val, ptr, 0);
+
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i64(val);
+}
+
+static TCGCond plugin_cond_to_tcgcond(enum qemu_plugin_cond cond)
+{
+    switch (cond) {
+    case QEMU_PLUGIN_COND_EQ:
+        return TCG_COND_EQ;
+    case QEMU_PLUGIN_COND_NE:
+        return TCG_COND_NE;
+    case QEMU_PLUGIN_COND_LT:
+        return TCG_COND_LTU;
+    case QEMU_PLUGIN_COND_LE:
+        return TCG_COND_LEU;
+    case QEMU_PLUGIN_COND_GT:
+        return TCG_COND_GTU;
+    case QEMU_PLUGIN_COND_GE:
+        return TCG_COND_GEU;
+    default:
+        /* NEVER and ALWAYS are resolved at registration time */
+        g_assert_not_reached();
+    }
+}
+
+/*
+ * Emit a call to the empty udata helper, then point it at the plugin's
+ * callback; see copy_call() for why we look for the helper's address.
+ */
+static void gen_udata_call(const struct qemu_plugin_dyn_cb *cb)
+{
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    TCGv_ptr udata = tcg_const_ptr(cb->userp);
+    TCGOp *op;
+    int i;
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    gen_helper_plugin_vcpu_udata_cb(cpu_index, udata);
+
+    op = QTAILQ_PREV(tcg_ctx->emit_before_op, link);
+    while (op->opc != INDEX_op_call) {
+        op = QTAILQ_PREV(op, link);
+    }
+    for (i = 0; i < MAX_OPC_PARAM_ARGS; i++) {
+        if ((uintptr_t)op->args[i] ==
+            (uintptr_t)HELPER(plugin_vcpu_udata_cb)) {
+            op->args[i] = (uintptr_t)cb->f.vcpu_udata;
+            break;
+        }
+    }
+    tcg_debug_assert(i < MAX_OPC_PARAM_ARGS);
+
+    tcg_temp_free_ptr(udata);
+    tcg_temp_free_i32(cpu_index);
+}
+
+static void gen_cond_cb(const struct qemu_plugin_dyn_cb *cb)
 {
-    inject_cb_type(cbs, begin_op, append_inline_cb, ok);
+    TCGLabel *skip = gen_new_label();
+    TCGv_i64 val = tcg_temp_new_i64();
+    TCGv_ptr ptr = gen_plugin_u64_ptr(cb->cond.entry);
+    TCGCond cond = plugin_cond_to_tcgcond(cb->cond.cond);
+
+    tcg_gen_ld_i64(val, ptr, 0);
+    tcg_gen_brcondi_i64(tcg_invert_cond(cond), val, cb->cond.imm, skip);
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i64(val);
+
+    gen_udata_call(cb);
+    gen_set_label(skip);
+}
+
+/*
+ * Inline ops, and then conditional callbacks so that they see the
+ * updated counters, are emitted with the regular tcg_gen_* helpers in
+ * place of the empty marker at @begin_op. Unlike the template copies
+ * above, this lets us generate per-vCPU addressing and branches.
+ *
+ * The temporaries are never shared with the frontend's, see
+ * plugin_gen_inject(). The conditional branch ends the basic block,
+ * though, so a frontend temporary that is live across it would be
+ * lost. Conditional callbacks are therefore only offered at TB and
+ * instruction start: a temporary still allocated there is a leak by
+ * the translator's rules, which translator_loop_temp_check() reports
+ * for targets that opt in, but nothing stops other targets from
+ * carrying one over.
+ */
+static void inject_inline_cb(const GArray *cbs, const GArray *cond_cbs,
+                             TCGOp *begin_op, op_ok_fn ok)
+{
+    int i;
+
+    tcg_ctx->emit_before_op = rm_ops(begin_op);
+    tcg_debug_assert(tcg_ctx->emit_before_op);
+
+    for (i = 0; cbs && i < cbs->len; i++) {
+        struct qemu_plugin_dyn_cb *cb =
+            &g_array_index(cbs, struct qemu_plugin_dyn_cb, i);
+
+        if (ok(begin_op, cb)) {
+            gen_inline_op(cb);
+        }
+    }
+    for (i = 0; cond_cbs && i < cond_cbs->len; i++) {
+        gen_cond_cb(&g_array_index(cond_cbs, struct qemu_plugin_dyn_cb, i));
+    }
+
+    tcg_ctx->emit_before_op = NULL;
 }
 
 static void
@@ -657,7 +750,8 @@ static void plugin_gen_tb_udata(const struct qemu_plugin_tb *ptb,
 static void plugin_gen_tb_inline(const struct qemu_plugin_tb *ptb,
                                  TCGOp *begin_op)
 {
-    inject_inline_cb(ptb->cbs[PLUGIN_CB_INLINE], begin_op, op_ok);
+    inject_inline_cb(ptb->cbs[PLUGIN_CB_INLINE], ptb->cbs[PLUGIN_CB_COND],
+                     begin_op, op_ok);
 }
 
 static void plugin_gen_insn_udata(const struct qemu_plugin_tb *ptb,
@@ -673,6 +767,7 @@ static void plugin_gen_insn_inline(const struct qemu_plugin_tb *ptb,
 {
     struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
     inject_inline_cb(insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_INLINE],
+                     insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_COND],
                      begin_op, op_ok);
 }
 
@@ -690,7 +785,7 @@ static void plugin_gen_mem_inline(const struct qemu_plugin_tb *ptb,
     struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
 
     cbs = insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_INLINE];
-    inject_inline_cb(cbs, begin_op, op_rw);
+    inject_inline_cb(cbs, NULL, begin_op, op_rw);
 }
 
 static void plugin_gen_enable_mem_helper(const struct qemu_plugin_tb *ptb,
@@ -823,6 +918,14 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
     int insn_idx;
 
     pr_ops();
+    /*
+     * Inline ops are generated with tcg_temp_new_*() after the frontend
+     * is done. By now it has freed its temps, but they may still be live
+     * where code is inserted, e.g. a load result that is moved to a
+     * global only after the mem callback marker, so make sure injected
+     * code gets fresh indexes.
+     */
+    memset(tcg_ctx->free_temps, 0, sizeof(tcg_ctx->free_temps));
     insn_idx = -1;
     QSIMPLEQ_FOREACH(op, &tcg_ctx->plugin_ops, plugin_link) {
         enum plugin_gen_from from = op->args[0];
@@ -34,6 +34,9 @@ struct TBContext {
 
     /* statistics */
     unsigned tb_flush_count;
+    unsigned tb_evict_count;
+    /* number of times cpu_exec_step_atomic() stopped all vCPUs */
+    unsigned exclusive_step_count;
 };
 
 extern TBContext tb_ctx;
@@ -16,33 +16,53 @@
 #include "exec/exec-all.h"
 #include "tb-hash.h"
 
+/* Add @tb to the jump cache of @cpu, in the current generation. */
+static inline void tb_jmp_cache_set(CPUState *cpu, target_ulong pc,
+                                    TranslationBlock *tb)
+{
+    TBJmpCacheEntry *jc = &cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)];
+
+    qatomic_set(&jc->gen, qatomic_read(&cpu->tb_jmp_cache_gen));
+    qatomic_set(&jc->tb, tb);
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *tb_lookup(CPUState *cpu, target_ulong pc,
                                           target_ulong cs_base,
                                           uint32_t flags, uint32_t cflags)
 {
     TranslationBlock *tb;
-    uint32_t hash;
+    TBJmpCacheEntry *jc;
+    unsigned int gen;
 
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
-    tb = qatomic_rcu_read(&cpu->tb_jmp_cache[hash]);
+    jc = &cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)];
+    gen = qatomic_read(&cpu->tb_jmp_cache_gen);
+    tb = qatomic_rcu_read(&jc->tb);
 
+    /* Check the generation first: stale entries may point to freed TBs. */
     if (likely(tb &&
+               qatomic_read(&jc->gen) == gen &&
                tb->pc == pc &&
                tb->cs_base == cs_base &&
                tb->flags == flags &&
                tb->trace_vcpu_dstate == *cpu->trace_dstate &&
                tb_cflags(tb) == cflags)) {
+#ifdef CONFIG_PROFILER
+        qatomic_set(&cpu->tb_jmp_cache_hit, cpu->tb_jmp_cache_hit + 1);
+#endif
         return tb;
     }
+#ifdef CONFIG_PROFILER
+    qatomic_set(&cpu->tb_jmp_cache_miss, cpu->tb_jmp_cache_miss + 1);
+#endif
     tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
         return NULL;
     }
-    qatomic_set(&cpu->tb_jmp_cache[hash], tb);
+    tb_jmp_cache_set(cpu, pc, tb);
     return tb;
 }
 
@@ -37,11 +37,14 @@
 #include "hw/boards.h"
 #endif
 #include "internal.h"
+#include "perf.h"
 
 struct TCGState {
     AccelState parent_obj;
 
     bool mttcg_enabled;
+    bool evict_enabled;
+    bool perfmap_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
 };
@@ -121,6 +124,10 @@ static int tcg_init_machine(MachineState *ms)
 
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
+    tb_evict_enabled = s->evict_enabled;
+    if (s->perfmap_enabled) {
+        perf_enable_perfmap();
+    }
 
     page_init();
     tb_htable_init();
@@ -208,6 +215,41 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+static bool tcg_get_tb_evict(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->evict_enabled;
+}
+
+static void tcg_set_tb_evict(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->evict_enabled = value;
+}
+
+static bool tcg_get_perfmap(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->perfmap_enabled;
+}
+
+static void tcg_set_perfmap(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->perfmap_enabled = value;
+}
+
+static bool tcg_get_env_forward(Object *obj, Error **errp)
+{
+    return qatomic_read(&tcg_env_forward_enabled);
+}
+
+static void tcg_set_env_forward(Object *obj, bool value, Error **errp)
+{
+    /* Takes effect for the next block translated.  */
+    qatomic_set(&tcg_env_forward_enabled, value);
+}
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -225,10 +267,25 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add_bool(oc, "tb-evict",
+        tcg_get_tb_evict, tcg_set_tb_evict);
+    object_class_property_set_description(oc, "tb-evict",
+        "Evict the oldest region of the TB cache instead of flushing it");
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
+
+    object_class_property_add_bool(oc, "perfmap",
+        tcg_get_perfmap, tcg_set_perfmap);
+    object_class_property_set_description(oc, "perfmap",
+        "Describe translated code in /tmp/perf-<pid>.map for Linux perf");
+
+    object_class_property_add_bool(oc, "env-forward",
+        tcg_get_env_forward, tcg_set_env_forward);
+    object_class_property_set_description(oc, "env-forward",
+        "Reuse CPU state values already loaded or stored in a block");
 }
 
 static const TypeInfo tcg_accel_type = {
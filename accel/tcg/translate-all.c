@@ -60,6 +60,7 @@
 #include "tb-hash.h"
 #include "tb-context.h"
 #include "internal.h"
+#include "perf.h"
 
 /* #define DEBUG_TB_INVALIDATE */
 /* #define DEBUG_TB_FLUSH */
@@ -220,6 +221,9 @@ static void *l1_map[V_L1_MAX_SIZE];
 
 TBContext tb_ctx;
 
+/* Evict single regions rather than flushing when the buffer fills up */
+bool tb_evict_enabled;
+
 static void page_table_config_init(void)
 {
     uint32_t v_l1_bits;
@@ -1022,6 +1026,43 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+/*
+ * Make room by evicting the oldest full region; the translations in
+ * the other regions remain valid.  Fall back to a full flush if there
+ * is nothing to evict, e.g. when there is a single region.
+ */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    bool did_evict = false;
+
+    mmap_lock();
+    /* Nothing to do if the buffer was flushed since the request. */
+    if (tb_ctx.tb_flush_count == tb_flush_count.host_int) {
+        did_evict = tcg_region_evict();
+        if (did_evict) {
+            qatomic_set(&tb_ctx.tb_evict_count, tb_ctx.tb_evict_count + 1);
+        }
+    }
+    mmap_unlock();
+
+    if (!did_evict) {
+        do_tb_flush(cpu, tb_flush_count);
+    }
+}
+
+/* Called when the code buffer of the current TCG context is exhausted. */
+static void tb_make_room(CPUState *cpu)
+{
+    unsigned tb_flush_count = qatomic_mb_read(&tb_ctx.tb_flush_count);
+    run_on_cpu_func func = tb_evict_enabled ? do_tb_evict : do_tb_flush;
+
+    if (cpu_in_exclusive_context(cpu)) {
+        func(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+    } else {
+        async_safe_run_on_cpu(cpu, func, RUN_ON_CPU_HOST_INT(tb_flush_count));
+    }
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1212,8 +1253,8 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     /* remove the TB from the hash list */
     h = tb_jmp_cache_hash_func(tb->pc);
     CPU_FOREACH(cpu) {
-        if (qatomic_read(&cpu->tb_jmp_cache[h]) == tb) {
-            qatomic_set(&cpu->tb_jmp_cache[h], NULL);
+        if (qatomic_read(&cpu->tb_jmp_cache[h].tb) == tb) {
+            qatomic_set(&cpu->tb_jmp_cache[h].tb, NULL);
         }
     }
 
@@ -1445,8 +1486,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* flush or eviction must be done */
+        tb_make_room(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1460,6 +1501,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+#ifdef CONFIG_PROFILER
+    tb->exec_count = 0;
+#endif
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -1626,6 +1670,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
 #endif
 
+    perf_report_code(tb);
+
     qatomic_set(&tcg_ctx->code_gen_ptr, (void *)
         ROUND_UP((uintptr_t)gen_code_buf + gen_code_size + search_size,
                  CODE_GEN_ALIGN));
@@ -2088,10 +2134,77 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
+#ifdef CONFIG_PROFILER
+#define TB_HOT_COUNT 10
+
+struct tb_hot_entry {
+    const TranslationBlock *tb;
+    size_t exec_count;
+};
+
+/* The TB_HOT_COUNT TBs that most often started a TB chain, hottest first */
+struct tb_hot_stats {
+    struct tb_hot_entry entry[TB_HOT_COUNT];
+    size_t n;
+};
+
+static gboolean tb_hot_stats_iter(gpointer key, gpointer value, gpointer data)
+{
+    const TranslationBlock *tb = value;
+    struct tb_hot_stats *hot = data;
+    size_t count = qatomic_read(&tb->exec_count);
+    size_t i;
+
+    if (count == 0) {
+        return false;
+    }
+    for (i = hot->n; i > 0 && hot->entry[i - 1].exec_count < count; i--) {
+        if (i < TB_HOT_COUNT) {
+            hot->entry[i] = hot->entry[i - 1];
+        }
+    }
+    if (i < TB_HOT_COUNT) {
+        hot->entry[i].tb = tb;
+        hot->entry[i].exec_count = count;
+        hot->n = MIN(hot->n + 1, TB_HOT_COUNT);
+    }
+    return false;
+}
+
+static void dump_tb_hot_info(void)
+{
+    struct tb_hot_stats hot = {};
+    size_t i;
+
+    tcg_tb_foreach(tb_hot_stats_iter, &hot);
+    if (hot.n == 0) {
+        return;
+    }
+    /*
+     * TBs reached through goto_tb or goto_ptr are not counted, so a hot
+     * loop that stays within chained TBs shows up only via its head.
+     */
+    qemu_printf("\nHottest TB chain heads:\n");
+    for (i = 0; i < hot.n; i++) {
+        const TranslationBlock *tb = hot.entry[i].tb;
+
+        qemu_printf("  pc 0x" TARGET_FMT_lx " entries %zu insns %u "
+                    "chained %c%c\n",
+                    tb->pc, hot.entry[i].exec_count, tb->icount,
+                    qatomic_read(&tb->jmp_dest[0]) ? 'y' : 'n',
+                    qatomic_read(&tb->jmp_dest[1]) ? 'y' : 'n');
+    }
+}
+#endif
+
 void dump_exec_info(void)
 {
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
+    CPUState *cpu;
+#ifdef CONFIG_PROFILER
+    size_t jc_hit = 0, jc_miss = 0;
+#endif
     size_t nb_tbs, flush_full, flush_part, flush_elide;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
@@ -2127,14 +2240,47 @@ void dump_exec_info(void)
     qemu_printf("\nStatistics:\n");
     qemu_printf("TB flush count      %u\n",
                 qatomic_read(&tb_ctx.tb_flush_count));
+    qemu_printf("TB evict count      %u\n",
+                qatomic_read(&tb_ctx.tb_evict_count));
     qemu_printf("TB invalidate count %zu\n",
                 tcg_tb_phys_invalidate_count());
+    qemu_printf("exclusive steps     %u\n",
+                qatomic_read(&tb_ctx.exclusive_step_count));
+    if (tcg_env_forward_enabled) {
+        size_t fwd_ops, fwd_tbs;
+
+        tcg_env_forward_counts(&fwd_ops, &fwd_tbs);
+        qemu_printf("env loads forwarded %zu (%0.2f per TB)\n", fwd_ops,
+                    fwd_tbs ? (double)fwd_ops / fwd_tbs : 0);
+    }
+#ifdef CONFIG_PROFILER
+    CPU_FOREACH(cpu) {
+        jc_hit += qatomic_read(&cpu->tb_jmp_cache_hit);
+        jc_miss += qatomic_read(&cpu->tb_jmp_cache_miss);
+    }
+    qemu_printf("TB jmp cache hits   %zu (%0.1f%% of %zu lookups)\n",
+                jc_hit, jc_hit + jc_miss ?
+                (double)jc_hit / (jc_hit + jc_miss) * 100 : 0,
+                jc_hit + jc_miss);
+#endif
 
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     qemu_printf("TLB full flushes    %zu\n", flush_full);
     qemu_printf("TLB partial flushes %zu\n", flush_part);
     qemu_printf("TLB elided flushes  %zu\n", flush_elide);
+    CPU_FOREACH(cpu) {
+        size_t vtlb_hit, vtlb_miss;
+
+        tlb_victim_counts(cpu, &vtlb_hit, &vtlb_miss);
+        qemu_printf("CPU %-3d victim TLB  %zu hits %zu misses (%0.1f%% hit)\n",
+                    cpu->cpu_index, vtlb_hit, vtlb_miss,
+                    vtlb_hit + vtlb_miss
+                    ? (double)vtlb_hit / (vtlb_hit + vtlb_miss) * 100 : 0);
+    }
     tcg_dump_info();
+#ifdef CONFIG_PROFILER
+    dump_tb_hot_info();
+#endif
 }
 
 void dump_opcount_info(void)
@@ -2271,7 +2417,17 @@ int page_get_flags(target_ulong address)
     if (!p) {
         return 0;
     }
-    return p->flags;
+    return qatomic_read(&p->flags);
+}
+
+/*
+ * Number of pages from @index to the end of its leaf in l1_map.  The
+ * PageDescs of a leaf are contiguous, so range walks only need one
+ * lookup per leaf.
+ */
+static inline target_ulong page_leaf_remain(tb_page_addr_t index)
+{
+    return V_L2_SIZE - (index & (V_L2_SIZE - 1));
 }
 
 /* Modify the flags of a page and invalidate the code if necessary.
@@ -2300,25 +2456,35 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
     reset_target_data = !(flags & PAGE_VALID) || (flags & PAGE_RESET);
     flags &= ~PAGE_RESET;
 
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        PageDesc *p = page_find_alloc(addr >> TARGET_PAGE_BITS, 1);
-
-        /* If the write protection bit is set, then we invalidate
-           the code inside.  */
-        if (!(p->flags & PAGE_WRITE) &&
-            (flags & PAGE_WRITE) &&
-            p->first_tb) {
-            tb_invalidate_phys_page(addr, 0);
+    for (addr = start, len = end - start; len != 0; ) {
+        tb_page_addr_t index = addr >> TARGET_PAGE_BITS;
+        target_ulong n = MIN(len >> TARGET_PAGE_BITS, page_leaf_remain(index));
+        /* Clearing the flags of pages never mapped is a no-op. */
+        PageDesc *p = page_find_alloc(index, flags != 0);
+
+        if (!p) {
+            addr += n << TARGET_PAGE_BITS;
+            len -= n << TARGET_PAGE_BITS;
+            continue;
         }
-        if (reset_target_data) {
-            g_free(p->target_data);
-            p->target_data = NULL;
-            p->flags = flags;
-        } else {
-            /* Using mprotect on a page does not change MAP_ANON. */
-            p->flags = (p->flags & PAGE_ANON) | flags;
+
+        for (; n != 0;
+             n--, p++, len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
+            /* If the write protection bit is set, then we invalidate
+               the code inside.  */
+            if (!(p->flags & PAGE_WRITE) &&
+                (flags & PAGE_WRITE) &&
+                p->first_tb) {
+                tb_invalidate_phys_page(addr, 0);
+            }
+            if (reset_target_data) {
+                g_free(p->target_data);
+                p->target_data = NULL;
+                qatomic_set(&p->flags, flags);
+            } else {
+                /* Using mprotect on a page does not change MAP_ANON. */
+                qatomic_set(&p->flags, (p->flags & PAGE_ANON) | flags);
+            }
         }
     }
 }
@@ -2368,36 +2534,58 @@ int page_check_range(target_ulong start, target_ulong len, int flags)
     end = TARGET_PAGE_ALIGN(start + len);
     start = start & TARGET_PAGE_MASK;
 
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        p = page_find(addr >> TARGET_PAGE_BITS);
+    for (addr = start, len = end - start; len != 0; ) {
+        tb_page_addr_t index = addr >> TARGET_PAGE_BITS;
+        target_ulong n = MIN(len >> TARGET_PAGE_BITS, page_leaf_remain(index));
+
+        p = page_find(index);
         if (!p) {
             return -1;
         }
-        if (!(p->flags & PAGE_VALID)) {
-            return -1;
-        }
+        for (; n != 0;
+             n--, p++, len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
+            int pflags = qatomic_read(&p->flags);
 
-        if ((flags & PAGE_READ) && !(p->flags & PAGE_READ)) {
-            return -1;
-        }
-        if (flags & PAGE_WRITE) {
-            if (!(p->flags & PAGE_WRITE_ORG)) {
+            if (!(pflags & PAGE_VALID)) {
+                return -1;
+            }
+
+            if ((flags & PAGE_READ) && !(pflags & PAGE_READ)) {
                 return -1;
             }
-            /* unprotect the page if it was put read-only because it
-               contains translated code */
-            if (!(p->flags & PAGE_WRITE)) {
-                if (!page_unprotect(addr, 0)) {
+            if (flags & PAGE_WRITE) {
+                if (!(pflags & PAGE_WRITE_ORG)) {
                     return -1;
                 }
+                /* unprotect the page if it was put read-only because it
+                   contains translated code */
+                if (!(pflags & PAGE_WRITE)) {
+                    if (!page_unprotect(addr, 0)) {
+                        return -1;
+                    }
+                }
             }
         }
     }
     return 0;
 }
 
+/*
+ * Called when a write hits a page that page_unprotect() has already made
+ * writable again, i.e. this thread raced with the one that did the TB
+ * invalidation.  Returns as page_unprotect().
+ */
+static int page_unprotect_raced(uintptr_t pc)
+{
+#ifdef TARGET_HAS_PRECISE_SMC
+    TranslationBlock *current_tb = tcg_tb_lookup(pc);
+    if (current_tb && (tb_cflags(current_tb) & CF_INVALID)) {
+        return 2;
+    }
+#endif
+    return 1;
+}
+
 /* called from signal handler: invalidate the code and unprotect the
  * page. Return 0 if the fault was not handled, 1 if it was handled,
  * and 2 if it was handled but the caller must cause the TB to be
@@ -2411,6 +2599,21 @@ int page_unprotect(target_ulong address, uintptr_t pc)
     PageDesc *p;
     target_ulong host_start, host_end, addr;
 
+    /*
+     * Fast path for threads that fault on a page which another thread
+     * has just unprotected: all the work is done, so don't serialize
+     * on mmap_lock.  PAGE_WRITE is only published after the mprotect
+     * below, so if we see it the write can simply be restarted.
+     */
+    p = page_find(address >> TARGET_PAGE_BITS);
+    if (!p) {
+        return 0;
+    }
+    if ((qatomic_load_acquire(&p->flags) & (PAGE_WRITE_ORG | PAGE_WRITE)) ==
+        (PAGE_WRITE_ORG | PAGE_WRITE)) {
+        return page_unprotect_raced(pc);
+    }
+
     /* Technically this isn't safe inside a signal handler.  However we
        know this only ever happens in a synchronous SEGV handler, so in
        practice it seems to be ok.  */
@@ -2431,12 +2634,8 @@ int page_unprotect(target_ulong address, uintptr_t pc)
              * this thread raced with another one which got here first and
              * set the page to PAGE_WRITE and did the TB invalidate for us.
              */
-#ifdef TARGET_HAS_PRECISE_SMC
-            TranslationBlock *current_tb = tcg_tb_lookup(pc);
-            if (current_tb) {
-                current_tb_invalidated = tb_cflags(current_tb) & CF_INVALID;
-            }
-#endif
+            mmap_unlock();
+            return page_unprotect_raced(pc);
         } else {
             host_start = address & qemu_host_page_mask;
             host_end = host_start + qemu_host_page_size;
@@ -2444,8 +2643,7 @@ int page_unprotect(target_ulong address, uintptr_t pc)
             prot = 0;
             for (addr = host_start; addr < host_end; addr += TARGET_PAGE_SIZE) {
                 p = page_find(addr >> TARGET_PAGE_BITS);
-                p->flags |= PAGE_WRITE;
-                prot |= p->flags;
+                prot |= p->flags | PAGE_WRITE;
 
                 /* and since the content will be modified, we must invalidate
                    the corresponding translated code. */
@@ -2458,6 +2656,12 @@ int page_unprotect(target_ulong address, uintptr_t pc)
             }
             mprotect((void *)g2h_untagged(host_start), qemu_host_page_size,
                      prot & PAGE_BITS);
+
+            /* Only now publish PAGE_WRITE for the lockless check above. */
+            for (addr = host_start; addr < host_end; addr += TARGET_PAGE_SIZE) {
+                p = page_find(addr >> TARGET_PAGE_BITS);
+                qatomic_store_release(&p->flags, p->flags | PAGE_WRITE);
+            }
         }
         mmap_unlock();
         /* If current TB was invalidated return to main loop */
@@ -0,0 +1,400 @@
+/*
+ * Copyright (c) 2026 QEMU contributors
+ *
+ * Statistical profiler. Every vCPU takes a sample each time it has
+ * executed another "period" guest instructions; samples are attributed
+ * to the translation block that was executing and, given the guest
+ * ELF image, resolved to the enclosing function at exit.
+ *
+ * The output is in the "folded stacks" format understood by
+ * flamegraph.pl and most other flame graph tools:
+ *
+ *   symbol count
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+/*
+ * Sampling is driven by the guest instruction count rather than by a
+ * host timer: a plugin cannot interrupt a running vCPU, and counting
+ * keeps the profile independent of host load. A prime default avoids
+ * aliasing with loops of a fixed trip count.
+ */
+static uint64_t period = 10007;
+static uint64_t bias;
+static const char *elf_path;
+static const char *out_path;
+
+typedef struct {
+    uint64_t insns;
+    uint64_t samples;
+} CPUSampler;
+
+static struct qemu_plugin_scoreboard *cpus;
+static qemu_plugin_u64 insns;
+static qemu_plugin_u64 samples;
+
+/* One entry per distinct TB start address, protected by lock */
+typedef struct {
+    uint64_t pc;
+    uint64_t count;
+} PCSample;
+
+static GMutex lock;
+static GHashTable *pcs;
+
+typedef struct {
+    uint64_t addr;
+    uint64_t size;
+    const char *name;
+} Symbol;
+
+static GArray *symbols;
+static gchar *elf_data;
+
+/*
+ * Minimal ELF symbol table reader
+ *
+ * We only need the function symbols of a single image, so rather than
+ * depend on libelf we pick the few fields we need out of the section
+ * and symbol headers by hand. Both classes and byte orders are
+ * handled, as the guest need not match the host.
+ */
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    bool is64;
+    bool big_endian;
+} ElfImage;
+
+#define SHT_SYMTAB  2
+#define SHT_DYNSYM  11
+#define STT_FUNC    2
+
+static bool elf_read(const ElfImage *elf, uint64_t off, int size,
+                     uint64_t *val)
+{
+    uint64_t v = 0;
+    int i;
+
+    if (off > elf->len || size > elf->len - off) {
+        return false;
+    }
+    for (i = 0; i < size; i++) {
+        int idx = elf->big_endian ? i : size - 1 - i;
+        v = (v << 8) | elf->data[off + idx];
+    }
+    *val = v;
+    return true;
+}
+
+/* Read a field that is 4 bytes wide in ELF32 and 8 bytes in ELF64 */
+static bool elf_read_word(const ElfImage *elf, uint64_t off, uint64_t *val)
+{
+    return elf_read(elf, off, elf->is64 ? 8 : 4, val);
+}
+
+static void elf_add_symbols(const ElfImage *elf, uint64_t symoff,
+                            uint64_t symsize, uint64_t stroff,
+                            uint64_t strsize)
+{
+    uint64_t entsize = elf->is64 ? 24 : 16;
+    uint64_t i;
+
+    for (i = 0; i + entsize <= symsize; i += entsize) {
+        uint64_t ent = symoff + i;
+        uint64_t name, info, value, size;
+        Symbol sym;
+
+        if (elf->is64) {
+            if (!elf_read(elf, ent, 4, &name) ||
+                !elf_read(elf, ent + 4, 1, &info) ||
+                !elf_read(elf, ent + 8, 8, &value) ||
+                !elf_read(elf, ent + 16, 8, &size)) {
+                return;
+            }
+        } else {
+            if (!elf_read(elf, ent, 4, &name) ||
+                !elf_read(elf, ent + 4, 4, &value) ||
+                !elf_read(elf, ent + 8, 4, &size) ||
+                !elf_read(elf, ent + 12, 1, &info)) {
+                return;
+            }
+        }
+
+        if ((info & 0xf) != STT_FUNC || value == 0 || name >= strsize) {
+            continue;
+        }
+        if (!memchr(elf->data + stroff + name, 0, strsize - name)) {
+            continue;
+        }
+
+        sym.addr = value + bias;
+        sym.size = size;
+        sym.name = (const char *) elf->data + stroff + name;
+        g_array_append_val(symbols, sym);
+    }
+}
+
+static gint cmp_symbol(gconstpointer a, gconstpointer b)
+{
+    const Symbol *sa = a, *sb = b;
+
+    if (sa->addr != sb->addr) {
+        return sa->addr < sb->addr ? -1 : 1;
+    }
+    /* Prefer the sized symbol when several alias one address */
+    return sa->size > sb->size ? -1 : sa->size < sb->size;
+}
+
+static bool load_symbols(const char *path)
+{
+    ElfImage elf;
+    GError *err = NULL;
+    gsize len;
+    uint64_t shoff, shentsize, shnum, i;
+
+    if (!g_file_get_contents(path, &elf_data, &len, &err)) {
+        fprintf(stderr, "sampler: %s\n", err->message);
+        g_error_free(err);
+        return false;
+    }
+
+    elf.data = (const uint8_t *) elf_data;
+    elf.len = len;
+    if (len < 0x40 || memcmp(elf_data, "\x7f" "ELF", 4) != 0 ||
+        (elf_data[4] != 1 && elf_data[4] != 2) ||
+        (elf_data[5] != 1 && elf_data[5] != 2)) {
+        fprintf(stderr, "sampler: %s is not an ELF file\n", path);
+        goto fail;
+    }
+    elf.is64 = elf_data[4] == 2;
+    elf.big_endian = elf_data[5] == 2;
+
+    if (!elf_read_word(&elf, elf.is64 ? 0x28 : 0x20, &shoff) ||
+        !elf_read(&elf, elf.is64 ? 0x3a : 0x2e, 2, &shentsize) ||
+        !elf_read(&elf, elf.is64 ? 0x3c : 0x30, 2, &shnum)) {
+        fprintf(stderr, "sampler: %s: truncated ELF header\n", path);
+        goto fail;
+    }
+
+    symbols = g_array_new(false, false, sizeof(Symbol));
+
+    for (i = 0; i < shnum; i++) {
+        uint64_t sh = shoff + i * shentsize;
+        uint64_t type, off, size, link, link_sh, stroff, strsize;
+        int w = elf.is64 ? 8 : 4;
+
+        /* sh_offset, sh_size and sh_link follow sh_flags and sh_addr */
+        if (!elf_read(&elf, sh + 4, 4, &type) ||
+            (type != SHT_SYMTAB && type != SHT_DYNSYM) ||
+            !elf_read_word(&elf, sh + 8 + 2 * w, &off) ||
+            !elf_read_word(&elf, sh + 8 + 3 * w, &size) ||
+            !elf_read(&elf, sh + 8 + 4 * w, 4, &link) ||
+            link >= shnum) {
+            continue;
+        }
+
+        link_sh = shoff + link * shentsize;
+        if (!elf_read_word(&elf, link_sh + 8 + 2 * w, &stroff) ||
+            !elf_read_word(&elf, link_sh + 8 + 3 * w, &strsize) ||
+            stroff > len || strsize > len - stroff) {
+            continue;
+        }
+
+        elf_add_symbols(&elf, off, size, stroff, strsize);
+    }
+
+    g_array_sort(symbols, cmp_symbol);
+    return true;
+
+fail:
+    g_free(elf_data);
+    elf_data = NULL;
+    return false;
+}
+
+/*
+ * Find the function containing addr. Symbols without a size are
+ * assumed to extend up to the next one.
+ */
+static const char *lookup_symbol(uint64_t addr)
+{
+    guint lo = 0, hi;
+    Symbol *sym;
+
+    if (!symbols || symbols->len == 0) {
+        return NULL;
+    }
+
+    hi = symbols->len;
+    while (hi - lo > 1) {
+        guint mid = (lo + hi) / 2;
+        if (g_array_index(symbols, Symbol, mid).addr <= addr) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    sym = &g_array_index(symbols, Symbol, lo);
+    if (addr < sym->addr) {
+        return NULL;
+    }
+    if (sym->size ? addr - sym->addr < sym->size : lo + 1 < symbols->len) {
+        return sym->name;
+    }
+    return NULL;
+}
+
+static gint cmp_count(gconstpointer a, gconstpointer b, gpointer d)
+{
+    GHashTable *h = d;
+    uint64_t ca = *(uint64_t *) g_hash_table_lookup(h, a);
+    uint64_t cb = *(uint64_t *) g_hash_table_lookup(h, b);
+
+    return ca > cb ? -1 : ca < cb;
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) report = g_string_new(NULL);
+    g_autoptr(GHashTable) folded = NULL;
+    g_autoptr(GList) keys = NULL;
+    GHashTableIter iter;
+    PCSample *s;
+    GList *it;
+    int i;
+
+    folded = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    g_mutex_lock(&lock);
+    g_hash_table_iter_init(&iter, pcs);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &s)) {
+        const char *name = lookup_symbol(s->pc);
+        g_autofree gchar *key = name ? g_strdup(name) :
+            g_strdup_printf("0x%016" PRIx64, s->pc);
+        uint64_t *count = g_hash_table_lookup(folded, key);
+
+        if (!count) {
+            count = g_new0(uint64_t, 1);
+            g_hash_table_insert(folded, g_steal_pointer(&key), count);
+        }
+        *count += s->count;
+    }
+    g_mutex_unlock(&lock);
+
+    keys = g_hash_table_get_keys(folded);
+    keys = g_list_sort_with_data(keys, cmp_count, folded);
+    for (it = keys; it; it = it->next) {
+        g_string_append_printf(report, "%s %" PRIu64 "\n",
+                               (char *) it->data,
+                               *(uint64_t *) g_hash_table_lookup(folded,
+                                                                 it->data));
+    }
+
+    if (out_path) {
+        GError *err = NULL;
+        if (!g_file_set_contents(out_path, report->str, report->len, &err)) {
+            fprintf(stderr, "sampler: %s\n", err->message);
+            g_error_free(err);
+        }
+        g_string_truncate(report, 0);
+    }
+
+    for (i = 0; i < qemu_plugin_num_vcpus(); i++) {
+        g_string_append_printf(report, "# cpu %d: %" PRIu64 " samples\n",
+                               i, qemu_plugin_u64_get(samples, i));
+    }
+    qemu_plugin_outs(report->str);
+}
+
+static void vcpu_sample(unsigned int cpu_index, void *udata)
+{
+    PCSample *s = udata;
+
+    qemu_plugin_u64_set(insns, cpu_index,
+                        qemu_plugin_u64_get(insns, cpu_index) - period);
+    qemu_plugin_u64_add(samples, cpu_index, 1);
+
+    g_mutex_lock(&lock);
+    s->count++;
+    g_mutex_unlock(&lock);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    uint64_t pc = qemu_plugin_tb_vaddr(tb);
+    PCSample *s;
+
+    g_mutex_lock(&lock);
+    s = g_hash_table_lookup(pcs, &pc);
+    if (!s) {
+        s = g_new0(PCSample, 1);
+        s->pc = pc;
+        g_hash_table_insert(pcs, &s->pc, s);
+    }
+    g_mutex_unlock(&lock);
+
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, insns, qemu_plugin_tb_n_insns(tb));
+    qemu_plugin_register_vcpu_tb_exec_cond_cb(
+        tb, vcpu_sample, QEMU_PLUGIN_CB_NO_REGS, QEMU_PLUGIN_COND_GE,
+        insns, period, s);
+}
+
+QEMU_PLUGIN_EXPORT
+int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
+                        int argc, char **argv)
+{
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        char *opt = argv[i];
+        g_auto(GStrv) tokens = g_strsplit(opt, "=", 2);
+
+        if (g_strcmp0(tokens[0], "period") == 0 && tokens[1]) {
+            period = g_ascii_strtoull(tokens[1], NULL, 0);
+        } else if (g_strcmp0(tokens[0], "bias") == 0 && tokens[1]) {
+            bias = g_ascii_strtoull(tokens[1], NULL, 0);
+        } else if (g_strcmp0(tokens[0], "elf") == 0 && tokens[1]) {
+            elf_path = opt + 4;
+        } else if (g_strcmp0(tokens[0], "outfile") == 0 && tokens[1]) {
+            out_path = opt + 8;
+        } else {
+            fprintf(stderr, "option parsing failed: %s\n", opt);
+            return -1;
+        }
+    }
+
+    if (period == 0) {
+        fprintf(stderr, "sampler: period must be non-zero\n");
+        return -1;
+    }
+
+    if (elf_path && !load_symbols(elf_path)) {
+        return -1;
+    }
+
+    cpus = qemu_plugin_scoreboard_new(sizeof(CPUSampler));
+    insns = qemu_plugin_scoreboard_u64_in_struct(cpus, CPUSampler, insns);
+    samples = qemu_plugin_scoreboard_u64_in_struct(cpus, CPUSampler, samples);
+    pcs = g_hash_table_new(g_int64_hash, g_int64_equal);
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
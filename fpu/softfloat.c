@@ -84,6 +84,7 @@ this code that are retained.
  */
 #include "qemu/osdep.h"
 #include <math.h>
+#include <float.h>
 #include "qemu/bitops.h"
 #include "fpu/softfloat.h"
 
@@ -125,6 +126,15 @@ this code that are retained.
  * detection might get hairy. Two examples: (1) when at least one operand is
  * denormal/inf/NaN; (2) when operands are not guaranteed to lead to a 0 result
  * and the result is < the minimum normal.
+ *
+ * For guests that clear the inexact flag often, or that use a rounding mode
+ * other than round-to-nearest-even, addition, subtraction and multiplication
+ * take a second path.  The error of the rounded-to-nearest host result is
+ * computed exactly, without touching the host FP environment, using
+ * error-free transformations: Knuth's 2Sum for additions, and an exact
+ * double product (float32) or a fused multiply-add (float64) for products.
+ * The sign of the error tells us whether the result is inexact, and
+ * whether it has to be moved by one ulp to honour a directed rounding mode.
  */
 #define GEN_INPUT_FLUSH__NOCHECK(name, soft_t)                          \
     static inline void name(soft_t *a, float_status *s)                 \
@@ -241,6 +251,59 @@ static inline bool can_use_fpu(const float_status *s)
                   s->float_rounding_mode == float_round_nearest_even);
 }
 
+/*
+ * Error-free transformations need the host to evaluate float and double
+ * expressions in their own precision, without excess precision.
+ */
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+# define QEMU_HARDFLOAT_USE_ERR 1
+#else
+# define QEMU_HARDFLOAT_USE_ERR 0
+#endif
+
+/* Only use fma() to compute product errors if it is a host instruction. */
+#if defined(FP_FAST_FMA)
+# define QEMU_HARDFLOAT_F64_MUL_ERR 1
+#else
+# define QEMU_HARDFLOAT_F64_MUL_ERR 0
+#endif
+
+static inline bool can_use_fpu_err(const float_status *s)
+{
+    if (QEMU_NO_HARDFLOAT || !QEMU_HARDFLOAT_USE_ERR) {
+        return false;
+    }
+    switch (s->float_rounding_mode) {
+    case float_round_nearest_even:
+    case float_round_to_zero:
+    case float_round_up:
+    case float_round_down:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Given the signs of a normal, rounded-to-nearest result and of its
+ * (nonzero) rounding error, return by how many ulps the magnitude of the
+ * result must be adjusted for the current rounding mode.
+ */
+static inline int hardfloat_round_adjust(const float_status *s,
+                                         bool r_neg, int err)
+{
+    switch (s->float_rounding_mode) {
+    case float_round_up:
+        return err < 0 ? 0 : r_neg ? -1 : 1;
+    case float_round_down:
+        return err > 0 ? 0 : r_neg ? 1 : -1;
+    case float_round_to_zero:
+        return (err < 0) != r_neg ? -1 : 0;
+    default:
+        return 0;
+    }
+}
+
 /*
  * Hardfloat generation functions. Each operation can have two flavors:
  * either using softfloat primitives (e.g. float32_is_zero_or_normal) for
@@ -271,6 +334,13 @@ typedef float64 (*soft_f64_op2_fn)(float64 a, float64 b, float_status *s);
 typedef float   (*hard_f32_op2_fn)(float a, float b);
 typedef double  (*hard_f64_op2_fn)(double a, double b);
 
+/*
+ * Return the sign (-1, 0 or 1) of the rounding error of @r, the host
+ * result of an operation on @a and @b, i.e. of the exact result minus @r.
+ */
+typedef int (*hard_f32_err2_fn)(float a, float b, float r);
+typedef int (*hard_f64_err2_fn)(double a, double b, double r);
+
 /* 2-input is-zero-or-normal */
 static inline bool f32_is_zon2(union_float32 a, union_float32 b)
 {
@@ -339,10 +409,76 @@ static inline bool f64_is_inf(union_float64 a)
     return float64_is_infinity(a.s);
 }
 
+/*
+ * Hardfloat for any rounding mode and regardless of the inexact flag.
+ * Results with a magnitude not above @min are left to soft-fp, which
+ * also takes care of overflow, underflow and the sign of zero results.
+ */
+static inline float32
+float32_gen2_err(union_float32 ua, union_float32 ub, float_status *s,
+                 hard_f32_op2_fn hard, soft_f32_op2_fn soft,
+                 f32_check_fn pre, hard_f32_err2_fn err, float min)
+{
+    union_float32 ur;
+    int e;
+
+    float32_input_flush2(&ua.s, &ub.s, s);
+    if (unlikely(!pre(ua, ub))) {
+        goto soft;
+    }
+
+    ur.h = hard(ua.h, ub.h);
+    if (unlikely(!(fabsf(ur.h) > min && fabsf(ur.h) < FLT_MAX))) {
+        goto soft;
+    }
+
+    e = err(ua.h, ub.h, ur.h);
+    if (e) {
+        float_raise(float_flag_inexact, s);
+        ur.s = make_float32(float32_val(ur.s) +
+                            hardfloat_round_adjust(s, ur.h < 0, e));
+    }
+    return ur.s;
+
+ soft:
+    return soft(ua.s, ub.s, s);
+}
+
+static inline float64
+float64_gen2_err(union_float64 ua, union_float64 ub, float_status *s,
+                 hard_f64_op2_fn hard, soft_f64_op2_fn soft,
+                 f64_check_fn pre, hard_f64_err2_fn err, double min)
+{
+    union_float64 ur;
+    int e;
+
+    float64_input_flush2(&ua.s, &ub.s, s);
+    if (unlikely(!pre(ua, ub))) {
+        goto soft;
+    }
+
+    ur.h = hard(ua.h, ub.h);
+    if (unlikely(!(fabs(ur.h) > min && fabs(ur.h) < DBL_MAX))) {
+        goto soft;
+    }
+
+    e = err(ua.h, ub.h, ur.h);
+    if (e) {
+        float_raise(float_flag_inexact, s);
+        ur.s = make_float64(float64_val(ur.s) +
+                            hardfloat_round_adjust(s, ur.h < 0, e));
+    }
+    return ur.s;
+
+ soft:
+    return soft(ua.s, ub.s, s);
+}
+
 static inline float32
 float32_gen2(float32 xa, float32 xb, float_status *s,
              hard_f32_op2_fn hard, soft_f32_op2_fn soft,
-             f32_check_fn pre, f32_check_fn post)
+             f32_check_fn pre, f32_check_fn post,
+             hard_f32_err2_fn err, float err_min)
 {
     union_float32 ua, ub, ur;
 
@@ -350,6 +486,9 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
     ub.s = xb;
 
     if (unlikely(!can_use_fpu(s))) {
+        if (err && can_use_fpu_err(s)) {
+            return float32_gen2_err(ua, ub, s, hard, soft, pre, err, err_min);
+        }
         goto soft;
     }
 
@@ -373,7 +512,8 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
 static inline float64
 float64_gen2(float64 xa, float64 xb, float_status *s,
              hard_f64_op2_fn hard, soft_f64_op2_fn soft,
-             f64_check_fn pre, f64_check_fn post)
+             f64_check_fn pre, f64_check_fn post,
+             hard_f64_err2_fn err, double err_min)
 {
     union_float64 ua, ub, ur;
 
@@ -381,6 +521,9 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
     ub.s = xb;
 
     if (unlikely(!can_use_fpu(s))) {
+        if (err && can_use_fpu_err(s)) {
+            return float64_gen2_err(ua, ub, s, hard, soft, pre, err, err_min);
+        }
         goto soft;
     }
 
@@ -1878,6 +2021,33 @@ static double hard_f64_sub(double a, double b)
     return a - b;
 }
 
+/* 2Sum: the error of a rounded-to-nearest sum is exactly representable */
+static int hard_f32_add_err(float a, float b, float r)
+{
+    float bv = r - a;
+    float e = (a - (r - bv)) + (b - bv);
+
+    return (e > 0) - (e < 0);
+}
+
+static int hard_f32_sub_err(float a, float b, float r)
+{
+    return hard_f32_add_err(a, -b, r);
+}
+
+static int hard_f64_add_err(double a, double b, double r)
+{
+    double bv = r - a;
+    double e = (a - (r - bv)) + (b - bv);
+
+    return (e > 0) - (e < 0);
+}
+
+static int hard_f64_sub_err(double a, double b, double r)
+{
+    return hard_f64_add_err(a, -b, r);
+}
+
 static bool f32_addsubmul_post(union_float32 a, union_float32 b)
 {
     if (QEMU_HARDFLOAT_2F32_USE_FP) {
@@ -1896,41 +2066,47 @@ static bool f64_addsubmul_post(union_float64 a, union_float64 b)
 }
 
 static float32 float32_addsub(float32 a, float32 b, float_status *s,
-                              hard_f32_op2_fn hard, soft_f32_op2_fn soft)
+                              hard_f32_op2_fn hard, soft_f32_op2_fn soft,
+                              hard_f32_err2_fn err)
 {
     return float32_gen2(a, b, s, hard, soft,
-                        f32_is_zon2, f32_addsubmul_post);
+                        f32_is_zon2, f32_addsubmul_post, err, FLT_MIN);
 }
 
 static float64 float64_addsub(float64 a, float64 b, float_status *s,
-                              hard_f64_op2_fn hard, soft_f64_op2_fn soft)
+                              hard_f64_op2_fn hard, soft_f64_op2_fn soft,
+                              hard_f64_err2_fn err)
 {
     return float64_gen2(a, b, s, hard, soft,
-                        f64_is_zon2, f64_addsubmul_post);
+                        f64_is_zon2, f64_addsubmul_post, err, DBL_MIN);
 }
 
 float32 QEMU_FLATTEN
 float32_add(float32 a, float32 b, float_status *s)
 {
-    return float32_addsub(a, b, s, hard_f32_add, soft_f32_add);
+    return float32_addsub(a, b, s, hard_f32_add, soft_f32_add,
+                          hard_f32_add_err);
 }
 
 float32 QEMU_FLATTEN
 float32_sub(float32 a, float32 b, float_status *s)
 {
-    return float32_addsub(a, b, s, hard_f32_sub, soft_f32_sub);
+    return float32_addsub(a, b, s, hard_f32_sub, soft_f32_sub,
+                          hard_f32_sub_err);
 }
 
 float64 QEMU_FLATTEN
 float64_add(float64 a, float64 b, float_status *s)
 {
-    return float64_addsub(a, b, s, hard_f64_add, soft_f64_add);
+    return float64_addsub(a, b, s, hard_f64_add, soft_f64_add,
+                          hard_f64_add_err);
 }
 
 float64 QEMU_FLATTEN
 float64_sub(float64 a, float64 b, float_status *s)
 {
-    return float64_addsub(a, b, s, hard_f64_sub, soft_f64_sub);
+    return float64_addsub(a, b, s, hard_f64_sub, soft_f64_sub,
+                          hard_f64_sub_err);
 }
 
 static bfloat16 QEMU_FLATTEN
@@ -2050,18 +2226,40 @@ static double hard_f64_mul(double a, double b)
     return a * b;
 }
 
+/* The product of two float32 values is exact in double precision */
+static int hard_f32_mul_err(float a, float b, float r)
+{
+    double e = (double)a * b - r;
+
+    return (e > 0) - (e < 0);
+}
+
+static int hard_f64_mul_err(double a, double b, double r)
+{
+    double e = fma(a, b, -r);
+
+    return (e > 0) - (e < 0);
+}
+
 float32 QEMU_FLATTEN
 float32_mul(float32 a, float32 b, float_status *s)
 {
     return float32_gen2(a, b, s, hard_f32_mul, soft_f32_mul,
-                        f32_is_zon2, f32_addsubmul_post);
+                        f32_is_zon2, f32_addsubmul_post,
+                        hard_f32_mul_err, FLT_MIN);
 }
 
 float64 QEMU_FLATTEN
 float64_mul(float64 a, float64 b, float_status *s)
 {
+    /*
+     * The error computed by fma() is exact, rather than rounded to zero,
+     * only if the product is well above the smallest normal.
+     */
     return float64_gen2(a, b, s, hard_f64_mul, soft_f64_mul,
-                        f64_is_zon2, f64_addsubmul_post);
+                        f64_is_zon2, f64_addsubmul_post,
+                        QEMU_HARDFLOAT_F64_MUL_ERR ? hard_f64_mul_err : NULL,
+                        0x1p-968);
 }
 
 bfloat16 QEMU_FLATTEN
@@ -2404,16 +2602,72 @@ float32 QEMU_FLATTEN
 float32_div(float32 a, float32 b, float_status *s)
 {
     return float32_gen2(a, b, s, hard_f32_div, soft_f32_div,
-                        f32_div_pre, f32_div_post);
+                        f32_div_pre, f32_div_post, NULL, 0);
 }
 
 float64 QEMU_FLATTEN
 float64_div(float64 a, float64 b, float_status *s)
 {
     return float64_gen2(a, b, s, hard_f64_div, soft_f64_div,
-                        f64_div_pre, f64_div_post);
+                        f64_div_pre, f64_div_post, NULL, 0);
 }
 
+/*
+ * Batch operations: d[i] = a[i] op b[i] for 0 <= i < n.
+ *
+ * Under the same conditions as hardfloat, the whole batch is computed by
+ * the host in two simple loops that the compiler can vectorize: the first
+ * one checks that every result is a finite normal, so that the only flag
+ * to raise would be inexact, which is already set; the second one stores
+ * the results.  Otherwise every element goes through the scalar function,
+ * which also takes care of raising the flags.  @d may alias @a or @b.
+ */
+#define GEN_BATCH2(name, soft_t, host_t, op, scalar, abs_fn, min, max)  \
+    void name(soft_t *d, const soft_t *a, const soft_t *b, size_t n,   \
+              float_status *s)                                          \
+    {                                                                   \
+        const host_t *ha = (const host_t *)a;                           \
+        const host_t *hb = (const host_t *)b;                           \
+        bool ok = can_use_fpu(s) && !s->flush_inputs_to_zero;           \
+        size_t i;                                                       \
+                                                                        \
+        if (likely(ok)) {                                               \
+            for (i = 0; i < n; i++) {                                   \
+                host_t r = ha[i] op hb[i];                              \
+                ok &= (abs_fn(r) > min) & (abs_fn(r) <= max);           \
+            }                                                           \
+        }                                                               \
+        if (likely(ok)) {                                               \
+            host_t *hd = (host_t *)d;                                   \
+            for (i = 0; i < n; i++) {                                   \
+                hd[i] = ha[i] op hb[i];                                 \
+            }                                                           \
+            return;                                                     \
+        }                                                               \
+        for (i = 0; i < n; i++) {                                       \
+            d[i] = scalar(a[i], b[i], s);                               \
+        }                                                               \
+    }
+
+GEN_BATCH2(float32_add_batch, float32, float, +, float32_add, fabsf,
+           FLT_MIN, FLT_MAX)
+GEN_BATCH2(float32_sub_batch, float32, float, -, float32_sub, fabsf,
+           FLT_MIN, FLT_MAX)
+GEN_BATCH2(float32_mul_batch, float32, float, *, float32_mul, fabsf,
+           FLT_MIN, FLT_MAX)
+GEN_BATCH2(float32_div_batch, float32, float, /, float32_div, fabsf,
+           FLT_MIN, FLT_MAX)
+GEN_BATCH2(float64_add_batch, float64, double, +, float64_add, fabs,
+           DBL_MIN, DBL_MAX)
+GEN_BATCH2(float64_sub_batch, float64, double, -, float64_sub, fabs,
+           DBL_MIN, DBL_MAX)
+GEN_BATCH2(float64_mul_batch, float64, double, *, float64_mul, fabs,
+           DBL_MIN, DBL_MAX)
+GEN_BATCH2(float64_div_batch, float64, double, /, float64_div, fabs,
+           DBL_MIN, DBL_MAX)
+
+#undef GEN_BATCH2
+
 bfloat16 QEMU_FLATTEN
 bfloat16_div(bfloat16 a, bfloat16 b, float_status *status)
 {
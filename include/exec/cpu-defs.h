@@ -76,8 +76,16 @@ typedef uint64_t target_ulong;
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
 
-/* use a fully associative victim tlb of 8 entries */
-#define CPU_VTLB_SIZE 8
+/*
+ * The victim tlb is set associative, with CPU_VTLB_WAYS entries in each
+ * of its CPU_VTLB_SETS sets.  The set is chosen by hashing the page
+ * number, so that pages that conflict in the direct-mapped fast tlb are
+ * spread over different sets.
+ */
+#define CPU_VTLB_SET_BITS 4
+#define CPU_VTLB_SETS (1 << CPU_VTLB_SET_BITS)
+#define CPU_VTLB_WAYS 4
+#define CPU_VTLB_SIZE (CPU_VTLB_SETS * CPU_VTLB_WAYS)
 
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
@@ -163,13 +171,22 @@ typedef struct CPUTLBDesc {
      */
     target_ulong large_page_addr;
     target_ulong large_page_mask;
+    /*
+     * The mask of the largest page allocated into the tlb.  A large page
+     * containing a given address lies entirely within the naturally
+     * aligned block matched under this mask, so flushing that block is
+     * sufficient to flush the large page.
+     */
+    target_ulong large_page_max_mask;
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
     size_t window_max_entries;
     size_t n_used_entries;
-    /* The next index to use in the tlb victim table.  */
-    size_t vindex;
+    /* The next way to use in each set of the tlb victim table.  */
+    uint8_t vindex[CPU_VTLB_SETS];
+    /* Bitmap of the sets of the tlb victim table that may be in use.  */
+    uint32_t vused;
     /* The tlb victim table, in two parts.  */
     CPUTLBEntry vtable[CPU_VTLB_SIZE];
     CPUIOTLBEntry viotlb[CPU_VTLB_SIZE];
@@ -208,6 +225,9 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /* Fast tlb misses that were, or were not, found in the victim tlb. */
+    size_t vtlb_hit_count;
+    size_t vtlb_miss_count;
 } CPUTLBCommon;
 
 /*
@@ -554,6 +554,15 @@ struct TranslationBlock {
     uintptr_t jmp_list_head;
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_dest[2];
+
+#ifdef CONFIG_PROFILER
+    /*
+     * Number of times execution of a TB chain started with this TB,
+     * i.e. it was entered from cpu_tb_exec() rather than through a
+     * goto_tb or goto_ptr from another TB.
+     */
+    size_t exec_count;
+#endif
 };
 
 /* Hide the qatomic_read to make code a little easier on the eyes */
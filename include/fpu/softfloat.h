@@ -594,6 +594,16 @@ bool float32_is_signaling_nan(float32, float_status *status);
 float32 float32_silence_nan(float32, float_status *status);
 float32 float32_scalbn(float32, int, float_status *status);
 
+/* d[i] = a[i] op b[i], for n elements; d may alias a or b. */
+void float32_add_batch(float32 *d, const float32 *a, const float32 *b,
+                       size_t n, float_status *status);
+void float32_sub_batch(float32 *d, const float32 *a, const float32 *b,
+                       size_t n, float_status *status);
+void float32_mul_batch(float32 *d, const float32 *a, const float32 *b,
+                       size_t n, float_status *status);
+void float32_div_batch(float32 *d, const float32 *a, const float32 *b,
+                       size_t n, float_status *status);
+
 static inline float32 float32_abs(float32 a)
 {
     /* Note that abs does *not* handle NaN specially, nor does
@@ -783,6 +793,16 @@ bool float64_is_signaling_nan(float64, float_status *status);
 float64 float64_silence_nan(float64, float_status *status);
 float64 float64_scalbn(float64, int, float_status *status);
 
+/* d[i] = a[i] op b[i], for n elements; d may alias a or b. */
+void float64_add_batch(float64 *d, const float64 *a, const float64 *b,
+                       size_t n, float_status *status);
+void float64_sub_batch(float64 *d, const float64 *a, const float64 *b,
+                       size_t n, float_status *status);
+void float64_mul_batch(float64 *d, const float64 *a, const float64 *b,
+                       size_t n, float_status *status);
+void float64_div_batch(float64 *d, const float64 *a, const float64 *b,
+                       size_t n, float_status *status);
+
 static inline float64 float64_abs(float64 a)
 {
     /* Note that abs does *not* handle NaN specially, nor does
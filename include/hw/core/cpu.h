@@ -219,6 +219,16 @@ struct hvf_vcpu_state;
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
 
+/*
+ * An entry of the per-vCPU jump cache.  It is valid only if @gen matches
+ * CPUState.tb_jmp_cache_gen, so that the whole cache can be invalidated
+ * at once by moving to the next generation.
+ */
+typedef struct TBJmpCacheEntry {
+    TranslationBlock *tb;
+    unsigned int gen;
+} TBJmpCacheEntry;
+
 /* work queue */
 
 /* The union type allows passing of 64 bit target pointers on 32 bit
@@ -348,7 +358,13 @@ struct CPUState {
     IcountDecr *icount_decr_ptr;
 
     /* Accessed in parallel; all accesses must be atomic */
-    TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    TBJmpCacheEntry tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    unsigned int tb_jmp_cache_gen;
+#ifdef CONFIG_PROFILER
+    /* Statistics, only updated by the vCPU thread but read atomically */
+    size_t tb_jmp_cache_hit;
+    size_t tb_jmp_cache_miss;
+#endif
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -426,11 +442,22 @@ extern __thread CPUState *current_cpu;
 
 static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
 {
-    unsigned int i;
+    unsigned int gen = qatomic_read(&cpu->tb_jmp_cache_gen) + 1;
 
-    for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i], NULL);
+    /*
+     * Entries from older generations are ignored, and may point to TBs
+     * that have since been freed.  Make sure none of them becomes valid
+     * again when the generation counter wraps around.
+     */
+    if (unlikely(gen == 0)) {
+        unsigned int i;
+
+        for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+            qatomic_set(&cpu->tb_jmp_cache[i].tb, NULL);
+        }
+        gen = 1;
     }
+    qatomic_set(&cpu->tb_jmp_cache_gen, gen);
 }
 
 /**
@@ -68,6 +68,7 @@ enum plugin_dyn_cb_type {
 enum plugin_dyn_cb_subtype {
     PLUGIN_CB_REGULAR,
     PLUGIN_CB_INLINE,
+    PLUGIN_CB_COND,
     PLUGIN_N_CB_SUBTYPES,
 };
 
@@ -84,13 +85,38 @@ struct qemu_plugin_dyn_cb {
     enum qemu_plugin_mem_rw rw;
     /* fields specific to each dyn_cb type go here */
     union {
+        /* @entry.score == NULL means a shared counter at @userp */
         struct {
             enum qemu_plugin_op op;
+            qemu_plugin_u64 entry;
             uint64_t imm;
         } inline_insn;
+        struct {
+            enum qemu_plugin_cond cond;
+            qemu_plugin_u64 entry;
+            uint64_t imm;
+        } cond;
     };
 };
 
+struct qemu_plugin_scoreboard {
+    GArray *data;
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
+};
+
+/*
+ * Return the address of @entry for @vcpu_index. Translated code embeds
+ * the address for vCPU 0 and adds vcpu_index * element size at run-time.
+ */
+static inline uint64_t *plugin_u64_address(qemu_plugin_u64 entry,
+                                           unsigned int vcpu_index)
+{
+    GArray *data = entry.score->data;
+
+    return (uint64_t *)(data->data + vcpu_index * g_array_get_element_size(data)
+                        + entry.offset);
+}
+
 /* Internal context for instrumenting an instruction */
 struct qemu_plugin_insn {
     GByteArray *data;
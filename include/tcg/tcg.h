@@ -569,6 +569,10 @@ struct TCGContext {
 
     size_t tb_phys_invalidate_count;
 
+    /* Loads removed by tcg_optimize_env_loads(), and TBs it has seen */
+    size_t env_fwd_ops;
+    size_t env_fwd_tbs;
+
     /* Track which vCPU triggers events */
     CPUState *cpu;                      /* *_trans */
 
@@ -597,6 +601,12 @@ struct TCGContext {
 
     /* list to quickly access the injected ops */
     QSIMPLEQ_HEAD(, TCGOp) plugin_ops;
+
+    /*
+     * When non-NULL, tcg_emit_op() inserts new ops before this one
+     * instead of appending them; used to inject instrumentation.
+     */
+    TCGOp *emit_before_op;
 #endif
 
     GHashTable *const_table[TCG_TYPE_COUNT];
@@ -626,6 +636,7 @@ extern __thread TCGContext *tcg_ctx;
 extern const void *tcg_code_gen_epilogue;
 extern uintptr_t tcg_splitwx_diff;
 extern TCGv_env cpu_env;
+extern bool tcg_env_forward_enabled;
 
 bool in_code_gen_buffer(const void *p);
 
@@ -798,6 +809,7 @@ TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tb_destroy(TranslationBlock *tb);
 void tcg_region_reset_all(void);
+bool tcg_region_evict(void);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -805,6 +817,7 @@ size_t tcg_code_capacity(void);
 void tcg_tb_insert(TranslationBlock *tb);
 void tcg_tb_remove(TranslationBlock *tb);
 size_t tcg_tb_phys_invalidate_count(void);
+void tcg_env_forward_counts(size_t *ops, size_t *tbs);
 TranslationBlock *tcg_tb_lookup(uintptr_t tc_ptr);
 void tcg_tb_foreach(GTraverseFunc func, gpointer user_data);
 size_t tcg_nb_tbs(void);
@@ -1015,6 +1028,7 @@ TCGOp *tcg_op_insert_after(TCGContext *s, TCGOp *op, TCGOpcode opc);
 void tcg_remove_ops_after(TCGOp *op);
 
 void tcg_optimize(TCGContext *s);
+void tcg_optimize_env_loads(TCGContext *s);
 
 /* Allocate a new temporary and initialize it with a constant. */
 TCGv_i32 tcg_const_i32(int32_t val);
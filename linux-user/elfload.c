@@ -2609,6 +2609,22 @@ static bool parse_elf_properties(int image_fd,
     }
 }
 
+/*
+ * Start reading a freshly mapped read-only segment and map its pages, so
+ * that the guest does not take a host page fault, and wait for the disk,
+ * on first touch of each page.  Purely advisory, so errors are ignored.
+ */
+static void prefault_segment(abi_ulong start, abi_ulong len)
+{
+    uintptr_t host_start = (uintptr_t)g2h_untagged(start) & qemu_host_page_mask;
+    uintptr_t host_end = HOST_PAGE_ALIGN((uintptr_t)g2h_untagged(start) + len);
+
+    madvise((void *)host_start, host_end - host_start, MADV_WILLNEED);
+#ifdef MADV_POPULATE_READ
+    madvise((void *)host_start, host_end - host_start, MADV_POPULATE_READ);
+#endif
+}
+
 /* Load an ELF image into the address space.
 
    IMAGE_NAME is the filename of the image, to use in error messages.
@@ -2852,6 +2868,10 @@ static void load_elf_image(const char *image_name, int image_fd,
                     goto exit_mmap;
                 }
 
+                if (prefault_elf_text && !(elf_prot & PROT_WRITE)) {
+                    prefault_segment(vaddr_ps, vaddr_len);
+                }
+
                 /*
                  * If the load segment requests extra zeros (e.g. bss), map it.
                  */
@@ -484,6 +484,7 @@ void mmap_fork_end(int child);
 
 /* main.c */
 extern unsigned long guest_stack_size;
+extern bool prefault_elf_text;
 
 /* user access */
 
@@ -123,6 +123,9 @@
 #include <libdrm/drm.h>
 #include <libdrm/i915_drm.h>
 #endif
+#ifdef HAVE_IO_URING_H
+#include <linux/io_uring.h>
+#endif
 #include "linux_loop.h"
 #include "uname.h"
 
@@ -365,6 +368,37 @@ _syscall5(int, sys_statx, int, dirfd, const char *, pathname, int, flags,
 _syscall2(int, membarrier, int, cmd, int, flags)
 #endif
 
+/*
+ * io_uring is passed through to the host for a small set of operations.
+ * The kernel reads SQEs and the memory they point to directly, so QEMU
+ * cannot translate any of it.  An operation is allowed only if it has
+ * nothing to translate: no flags, socket levels or structures whose
+ * layout differs between guest and host, and no paths, because those
+ * would bypass the -L prefix and the /proc/self emulation.  This also
+ * needs guest pointers to be host pointers, with the same size and
+ * byte order.  guest_base is only known at run time, so it is checked
+ * at setup.  Completions carry host errnos, so rings are only offered
+ * when the target numbers errnos like the host.
+ *
+ * Restrictions need IORING_SETUP_R_DISABLED.  Without it the host
+ * would accept every operation it knows, so io_uring stays unsupported.
+ */
+#if defined(HAVE_IO_URING_H) && defined(TARGET_NR_io_uring_setup) && \
+    defined(__NR_io_uring_setup) && defined(IORING_SETUP_R_DISABLED) && \
+    TARGET_ABI_BITS == HOST_LONG_BITS && \
+    defined(HOST_WORDS_BIGENDIAN) == defined(TARGET_WORDS_BIGENDIAN)
+#define EMULATE_IO_URING
+#endif
+
+#ifdef EMULATE_IO_URING
+#define __NR_sys_io_uring_setup __NR_io_uring_setup
+_syscall2(int, sys_io_uring_setup, uint32_t, entries,
+          struct io_uring_params *, params)
+#define __NR_sys_io_uring_register __NR_io_uring_register
+_syscall4(int, sys_io_uring_register, unsigned int, fd, unsigned int, opcode,
+          void *, arg, unsigned int, nr_args)
+#endif
+
 static const bitmask_transtbl fcntl_flags_tbl[] = {
   { TARGET_O_ACCMODE,   TARGET_O_WRONLY,    O_ACCMODE,   O_WRONLY,    },
   { TARGET_O_ACCMODE,   TARGET_O_RDWR,      O_ACCMODE,   O_RDWR,      },
@@ -758,6 +792,11 @@ safe_syscall6(int,futex_time64,int *,uaddr,int,op,int,val, \
               const struct timespec *,timeout,int *,uaddr2,int,val3)
 #endif
 safe_syscall2(int, rt_sigsuspend, sigset_t *, newset, size_t, sigsetsize)
+#ifdef EMULATE_IO_URING
+safe_syscall6(int, io_uring_enter, unsigned int, fd, unsigned int, to_submit,
+              unsigned int, min_complete, unsigned int, flags,
+              const void *, arg, size_t, argsz)
+#endif
 safe_syscall2(int, kill, pid_t, pid, int, sig)
 safe_syscall2(int, tkill, int, tid, int, sig)
 safe_syscall3(int, tgkill, int, tgid, int, pid, int, sig)
@@ -8265,6 +8304,428 @@ static int host_to_target_cpu_mask(const unsigned long *host_mask,
 _syscall2(int, pivot_root, const char *, new_root, const char *, put_old)
 #endif
 
+#ifdef EMULATE_IO_URING
+/*
+ * These operations carry at most fds, plain buffers, iovecs and a
+ * struct __kernel_timespec, all of which have the same layout on guest
+ * and host.  Their buffers are checked by io_uring_check_sqe().
+ */
+static const uint8_t io_uring_sqe_ops[] = {
+    IORING_OP_NOP, IORING_OP_READV, IORING_OP_WRITEV, IORING_OP_FSYNC,
+    IORING_OP_POLL_ADD, IORING_OP_POLL_REMOVE, IORING_OP_TIMEOUT,
+    IORING_OP_READ, IORING_OP_WRITE,
+};
+
+/* Fixed files and provided buffers need registration, which is refused. */
+#define IO_URING_SQE_FLAGS \
+    (IOSQE_IO_DRAIN | IOSQE_IO_LINK | IOSQE_IO_HARDLINK | IOSQE_ASYNC)
+
+/*
+ * SQPOLL would let the kernel consume SQEs before io_uring_enter has
+ * checked them, and SQE128 or NO_SQARRAY change the ring layout.
+ */
+#define IO_URING_SETUP_FLAGS \
+    (IORING_SETUP_IOPOLL | IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP)
+
+/* Register opcodes handled by do_io_uring_register(). */
+static const uint8_t io_uring_register_ops[] = {
+    IORING_REGISTER_EVENTFD, IORING_UNREGISTER_EVENTFD,
+    IORING_REGISTER_EVENTFD_ASYNC, IORING_REGISTER_PROBE,
+};
+
+/*
+ * The kernel accesses guest memory without looking at the page flags:
+ * it would write to a page that is still unmapped for the guest, and
+ * get -EFAULT on a page that QEMU made read-only because it holds
+ * translated code.  Before each submission, io_uring_enter therefore
+ * checks the buffers of the pending SQEs with page_check_range(), which
+ * also unprotects such pages.  The SQ ring and the SQEs are read
+ * through a mapping of QEMU's own, as the guest may map them anywhere.
+ */
+typedef struct IOUringRing {
+    uint8_t *sq_ring;
+    size_t sq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    uint32_t *head, *tail, *mask, *array;
+    uint32_t entries;
+    int refcnt;
+} IOUringRing;
+
+static pthread_mutex_t io_uring_lock = PTHREAD_MUTEX_INITIALIZER;
+static GHashTable *io_uring_rings;
+
+static void io_uring_ring_unref(gpointer data)
+{
+    IOUringRing *ring = data;
+
+    if (qatomic_fetch_dec(&ring->refcnt) != 1) {
+        return;
+    }
+    if (ring->sq_ring != MAP_FAILED) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    g_free(ring);
+}
+
+static abi_long io_uring_track(int fd, const struct io_uring_params *p)
+{
+    IOUringRing *ring = g_new0(IOUringRing, 1);
+    abi_long ret;
+
+    ring->refcnt = 1;
+    ring->entries = p->sq_entries;
+    ring->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(uint32_t);
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ, MAP_SHARED,
+                         fd, IORING_OFF_SQ_RING);
+    ring->sqes = MAP_FAILED;
+    if (ring->sq_ring == MAP_FAILED) {
+        ret = -host_to_target_errno(errno);
+        io_uring_ring_unref(ring);
+        return ret;
+    }
+    ring->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ, MAP_SHARED,
+                      fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ret = -host_to_target_errno(errno);
+        io_uring_ring_unref(ring);
+        return ret;
+    }
+    ring->head = (uint32_t *)(ring->sq_ring + p->sq_off.head);
+    ring->tail = (uint32_t *)(ring->sq_ring + p->sq_off.tail);
+    ring->mask = (uint32_t *)(ring->sq_ring + p->sq_off.ring_mask);
+    ring->array = (uint32_t *)(ring->sq_ring + p->sq_off.array);
+
+    pthread_mutex_lock(&io_uring_lock);
+    if (!io_uring_rings) {
+        io_uring_rings = g_hash_table_new_full(NULL, NULL, NULL,
+                                               io_uring_ring_unref);
+    }
+    g_hash_table_replace(io_uring_rings, GINT_TO_POINTER(fd), ring);
+    pthread_mutex_unlock(&io_uring_lock);
+    return 0;
+}
+
+/* Called when the guest closes @fd or replaces it with dup2/dup3. */
+static void io_uring_forget(int fd)
+{
+    pthread_mutex_lock(&io_uring_lock);
+    if (io_uring_rings) {
+        g_hash_table_remove(io_uring_rings, GINT_TO_POINTER(fd));
+    }
+    pthread_mutex_unlock(&io_uring_lock);
+}
+
+static abi_long io_uring_check_buf(int type, uint64_t addr, uint64_t len)
+{
+    if (addr != (abi_ulong)addr || len != (abi_ulong)len ||
+        !access_ok_untagged(type, addr, len)) {
+        return -TARGET_EFAULT;
+    }
+    return 0;
+}
+
+static abi_long io_uring_check_iov(int type, uint64_t addr, uint32_t count)
+{
+    struct target_iovec *vec;
+    abi_long ret = 0;
+    uint32_t i;
+
+    if (count > IOV_MAX) {
+        return -TARGET_EINVAL;
+    }
+    if (addr != (abi_ulong)addr) {
+        return -TARGET_EFAULT;
+    }
+    vec = lock_user(VERIFY_READ, addr, count * sizeof(*vec), 1);
+    if (!vec) {
+        return -TARGET_EFAULT;
+    }
+    for (i = 0; i < count && !ret; i++) {
+        ret = io_uring_check_buf(type, tswapal(vec[i].iov_base),
+                                 tswapal(vec[i].iov_len));
+    }
+    unlock_user(vec, addr, 0);
+    return ret;
+}
+
+static abi_long io_uring_check_sqe(const struct io_uring_sqe *sqe)
+{
+    uint8_t op = qatomic_read(&sqe->opcode);
+    int type = VERIFY_READ;
+
+    switch (op) {
+    case IORING_OP_READ:
+    case IORING_OP_READV:
+        type = VERIFY_WRITE;
+        /* fall through */
+    case IORING_OP_WRITE:
+    case IORING_OP_WRITEV:
+        if (fd_trans_target_to_host_data(sqe->fd) ||
+            fd_trans_host_to_target_data(sqe->fd)) {
+            return -TARGET_EINVAL;
+        }
+        if (op == IORING_OP_READ || op == IORING_OP_WRITE) {
+            return io_uring_check_buf(type, sqe->addr, sqe->len);
+        }
+        return io_uring_check_iov(type, sqe->addr, sqe->len);
+    case IORING_OP_TIMEOUT:
+        return io_uring_check_buf(VERIFY_READ, sqe->addr,
+                                  sizeof(struct __kernel_timespec));
+    default:
+        /* No pointers, or refused by the kernel's restrictions. */
+        return 0;
+    }
+}
+
+/*
+ * Check the SQEs that io_uring_enter is about to submit.  The guest
+ * can still change them afterwards, but then it only gets the -EFAULT
+ * it asked for.  page_check_range() may take the mmap lock, so the
+ * ring is held by reference rather than under io_uring_lock.
+ */
+static abi_long io_uring_check_sqes(int fd, unsigned int to_submit)
+{
+    IOUringRing *ring = NULL;
+    uint32_t head, n, mask, idx, i;
+    abi_long ret = 0;
+
+    pthread_mutex_lock(&io_uring_lock);
+    if (io_uring_rings) {
+        ring = g_hash_table_lookup(io_uring_rings, GINT_TO_POINTER(fd));
+    }
+    if (ring) {
+        qatomic_inc(&ring->refcnt);
+    }
+    pthread_mutex_unlock(&io_uring_lock);
+    if (!ring) {
+        /* Not a ring created by the guest, e.g. a dup()ed descriptor. */
+        return -TARGET_EOPNOTSUPP;
+    }
+
+    head = qatomic_read(ring->head);
+    n = MIN(to_submit, qatomic_load_acquire(ring->tail) - head);
+    mask = qatomic_read(ring->mask);
+    for (i = 0; i < n && !ret; i++) {
+        idx = qatomic_read(&ring->array[(head + i) & mask]);
+        if (idx < ring->entries) {
+            ret = io_uring_check_sqe(&ring->sqes[idx]);
+        }
+    }
+    io_uring_ring_unref(ring);
+    return ret;
+}
+
+/*
+ * The ring was created disabled, as restrictions can only be set up
+ * before it is enabled.
+ */
+static abi_long io_uring_restrict(int fd)
+{
+    struct io_uring_restriction res[ARRAY_SIZE(io_uring_sqe_ops) +
+                                    ARRAY_SIZE(io_uring_register_ops) + 1];
+    unsigned int i, n = 0;
+    abi_long ret;
+
+    memset(res, 0, sizeof(res));
+    for (i = 0; i < ARRAY_SIZE(io_uring_sqe_ops); i++) {
+        res[n].opcode = IORING_RESTRICTION_SQE_OP;
+        res[n++].sqe_op = io_uring_sqe_ops[i];
+    }
+    for (i = 0; i < ARRAY_SIZE(io_uring_register_ops); i++) {
+        res[n].opcode = IORING_RESTRICTION_REGISTER_OP;
+        res[n++].register_op = io_uring_register_ops[i];
+    }
+    res[n].opcode = IORING_RESTRICTION_SQE_FLAGS_ALLOWED;
+    res[n++].sqe_flags = IO_URING_SQE_FLAGS;
+
+    ret = get_errno(sys_io_uring_register(fd, IORING_REGISTER_RESTRICTIONS,
+                                          res, n));
+    if (is_error(ret)) {
+        return ret;
+    }
+    return get_errno(sys_io_uring_register(fd, IORING_REGISTER_ENABLE_RINGS,
+                                           NULL, 0));
+}
+
+static bool io_uring_errnos_match(void)
+{
+    int i;
+
+    for (i = 1; i < ERRNO_TABLE_SIZE; i++) {
+        if (host_to_target_errno(i) != i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static abi_long do_io_uring_setup(uint32_t entries, abi_ulong target_params)
+{
+    struct io_uring_params params;
+    abi_long ret, err;
+
+    /* SQEs carry guest addresses, which the kernel uses as they are. */
+    if (guest_base != 0 || !io_uring_errnos_match()) {
+        return -TARGET_ENOSYS;
+    }
+    if (copy_from_user(&params, target_params, sizeof(params))) {
+        return -TARGET_EFAULT;
+    }
+    if (params.flags & ~IO_URING_SETUP_FLAGS) {
+        return -TARGET_EINVAL;
+    }
+    params.flags |= IORING_SETUP_R_DISABLED;
+
+    ret = get_errno(sys_io_uring_setup(entries, &params));
+    if (is_error(ret)) {
+        return ret;
+    }
+    params.flags &= ~IORING_SETUP_R_DISABLED;
+
+    err = io_uring_restrict(ret);
+    if (!is_error(err)) {
+        err = io_uring_track(ret, &params);
+    }
+    if (!is_error(err) && copy_to_user(target_params, &params,
+                                       sizeof(params))) {
+        err = -TARGET_EFAULT;
+    }
+    if (is_error(err)) {
+        io_uring_forget(ret);
+        close(ret);
+        return err;
+    }
+    return ret;
+}
+
+static abi_long do_io_uring_register(unsigned int fd, unsigned int opcode,
+                                     abi_ulong arg, unsigned int nr_args)
+{
+    struct io_uring_probe *probe;
+    void *p = NULL;
+    size_t len = 0;
+    int type = VERIFY_READ;
+    abi_long ret;
+    unsigned int i, j;
+
+    switch (opcode) {
+    case IORING_REGISTER_EVENTFD:
+    case IORING_REGISTER_EVENTFD_ASYNC:
+        len = sizeof(int32_t);
+        break;
+    case IORING_UNREGISTER_EVENTFD:
+        break;
+    case IORING_REGISTER_PROBE:
+        nr_args = MIN(nr_args, 256);
+        len = sizeof(*probe) + nr_args * sizeof(probe->ops[0]);
+        type = VERIFY_WRITE;
+        break;
+    default:
+        /* Everything else pins or reads guest memory behind our back. */
+        return -TARGET_EINVAL;
+    }
+
+    if (len) {
+        p = lock_user(type, arg, len, 1);
+        if (!p) {
+            return -TARGET_EFAULT;
+        }
+    }
+    ret = get_errno(sys_io_uring_register(fd, opcode, p, nr_args));
+    if (opcode == IORING_REGISTER_PROBE && !is_error(ret)) {
+        /* Do not advertise what the restrictions will refuse. */
+        probe = p;
+        for (i = 0; i < MIN(probe->ops_len, nr_args); i++) {
+            for (j = 0; j < ARRAY_SIZE(io_uring_sqe_ops); j++) {
+                if (probe->ops[i].op == io_uring_sqe_ops[j]) {
+                    break;
+                }
+            }
+            if (j == ARRAY_SIZE(io_uring_sqe_ops)) {
+                probe->ops[i].flags &= ~IO_URING_OP_SUPPORTED;
+            }
+        }
+    }
+    if (len) {
+        unlock_user(p, arg, type == VERIFY_WRITE ? len : 0);
+    }
+    return ret;
+}
+
+static abi_long do_io_uring_enter(unsigned int fd, unsigned int to_submit,
+                                  unsigned int min_complete,
+                                  unsigned int flags, abi_ulong arg,
+                                  abi_ulong argsz)
+{
+    target_sigset_t *target_set;
+    abi_ulong target_set_addr = 0;
+    sigset_t set;
+    void *p = NULL;
+#ifdef IORING_ENTER_EXT_ARG
+    struct io_uring_getevents_arg ext;
+#endif
+
+    /*
+     * Only the signal mask needs converting; the rest of the
+     * arguments are fixed-size or already host pointers.
+     */
+#ifdef IORING_ENTER_EXT_ARG
+    if (flags & IORING_ENTER_EXT_ARG) {
+        if (arg) {
+            if (argsz != sizeof(ext)) {
+                return -TARGET_EINVAL;
+            }
+            if (copy_from_user(&ext, arg, sizeof(ext))) {
+                return -TARGET_EFAULT;
+            }
+            if (ext.sigmask) {
+                if (ext.sigmask_sz != sizeof(target_sigset_t)) {
+                    return -TARGET_EINVAL;
+                }
+                target_set_addr = ext.sigmask;
+                ext.sigmask = (uintptr_t)&set;
+                ext.sigmask_sz = SIGSET_T_SIZE;
+            }
+            p = &ext;
+        }
+    } else
+#endif
+    if (arg) {
+        if (argsz != sizeof(target_sigset_t)) {
+            return -TARGET_EINVAL;
+        }
+        target_set_addr = arg;
+        p = &set;
+        argsz = SIGSET_T_SIZE;
+    }
+
+    if (target_set_addr) {
+        target_set = lock_user(VERIFY_READ, target_set_addr,
+                               sizeof(target_sigset_t), 1);
+        if (!target_set) {
+            return -TARGET_EFAULT;
+        }
+        target_to_host_sigset(&set, target_set);
+        unlock_user(target_set, target_set_addr, 0);
+    }
+
+    if (to_submit) {
+        abi_long ret = io_uring_check_sqes(fd, to_submit);
+        if (is_error(ret)) {
+            return ret;
+        }
+    }
+
+    return get_errno(safe_io_uring_enter(fd, to_submit, min_complete, flags,
+                                         p, argsz));
+}
+#endif
+
 /* This is an internal helper for do_syscall so that it is easier
  * to have a single return point, so that actions, such as logging
  * of syscall results, can be performed.
@@ -8397,6 +8858,9 @@ static abi_long do_syscall1(void *cpu_env, int num, abi_long arg1,
 #endif
     case TARGET_NR_close:
         fd_trans_unregister(arg1);
+#ifdef EMULATE_IO_URING
+        io_uring_forget(arg1);
+#endif
         return get_errno(close(arg1));
 
     case TARGET_NR_brk:
@@ -8968,6 +9432,11 @@ static abi_long do_syscall1(void *cpu_env, int num, abi_long arg1,
         ret = get_errno(dup2(arg1, arg2));
         if (ret >= 0) {
             fd_trans_dup(arg1, arg2);
+#ifdef EMULATE_IO_URING
+            if (arg1 != arg2) {
+                io_uring_forget(arg2);
+            }
+#endif
         }
         return ret;
 #endif
@@ -8983,6 +9452,9 @@ static abi_long do_syscall1(void *cpu_env, int num, abi_long arg1,
         ret = get_errno(dup3(arg1, arg2, host_flags));
         if (ret >= 0) {
             fd_trans_dup(arg1, arg2);
+#ifdef EMULATE_IO_URING
+            io_uring_forget(arg2);
+#endif
         }
         return ret;
     }
@@ -13189,6 +13661,14 @@ static abi_long do_syscall1(void *cpu_env, int num, abi_long arg1,
     case TARGET_NR_membarrier:
         return get_errno(membarrier(arg1, arg2));
 #endif
+#ifdef EMULATE_IO_URING
+    case TARGET_NR_io_uring_setup:
+        return do_io_uring_setup(arg1, arg2);
+    case TARGET_NR_io_uring_enter:
+        return do_io_uring_enter(arg1, arg2, arg3, arg4, arg5, arg6);
+    case TARGET_NR_io_uring_register:
+        return do_io_uring_register(arg1, arg2, arg3, arg4);
+#endif
 
 #if defined(TARGET_NR_copy_file_range) && defined(__NR_copy_file_range)
     case TARGET_NR_copy_file_range:
@@ -13251,6 +13731,15 @@ static abi_long do_syscall1(void *cpu_env, int num, abi_long arg1,
     return ret;
 }
 
+/*
+ * Note that there is deliberately no separate fast path for the simple
+ * syscalls: do_syscall1() is a dense switch on the syscall number that
+ * the compiler turns into a jump table, and calls such as getpid() or
+ * read() on an ordinary fd go straight to the host with no conversion
+ * beyond lock_user().  The tracing and plugin hooks below cost a flag
+ * test each when disabled.  What remains per call is leaving and
+ * re-entering cpu_exec() and the host syscall itself.
+ */
 abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
                     abi_long arg2, abi_long arg3, abi_long arg4,
                     abi_long arg5, abi_long arg6, abi_long arg7,
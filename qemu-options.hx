@@ -141,6 +141,9 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-evict=on|off (evict old TCG translations instead of flushing)\n"
+    "                perfmap=on|off (write TCG symbols to /tmp/perf-<pid>.map)\n"
+    "                env-forward=on|off (forward CPU state loads within TCG blocks)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
@@ -175,6 +178,24 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-evict=on|off``
+        When the TCG translation block cache fills up, discard only the
+        oldest part of it instead of all translations.  This only has an
+        effect with ``thread=multi``, where the cache is split into
+        several regions; otherwise the whole cache is still flushed.
+
+    ``perfmap=on|off``
+        Write a line describing each translated block to
+        ``/tmp/perf-<pid>.map``, so that Linux ``perf`` can attribute
+        time spent in translated code to the guest address (and, where
+        guest symbols are known, the guest function) it came from.
+
+    ``env-forward=on|off``
+        Let the TCG optimizer replace a load of a CPU state field with
+        the value already loaded from or stored to it earlier in the
+        same basic block.  The number of loads removed is shown by the
+        ``info jit`` monitor command.  Defaults to off.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
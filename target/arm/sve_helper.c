@@ -4315,21 +4315,76 @@ void HELPER(NAME)(void *vd, void *vn, void *vm, void *vg,       \
     } while (i != 0);                                           \
 }
 
+/* Return true if all elements of size esz of an oprsz-byte vector are active */
+static bool pred_all_active(const uint64_t *g, intptr_t oprsz, int esz)
+{
+    uint64_t mask = pred_esz_masks[esz];
+    intptr_t i;
+
+    for (i = 0; i < oprsz / 64; i++) {
+        if ((g[i] & mask) != mask) {
+            return false;
+        }
+    }
+    if (oprsz & 63) {
+        mask &= MAKE_64BIT_MASK(0, oprsz & 63);
+        if ((g[i] & mask) != mask) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * As DO_ZPZZ_FP, but hand the whole vector to the softfloat batch
+ * function BATCH when all elements are active.
+ */
+#define DO_ZPZZ_FP_BATCH(NAME, TYPE, ESZ, H, OP, BATCH)         \
+void HELPER(NAME)(void *vd, void *vn, void *vm, void *vg,       \
+                  void *status, uint32_t desc)                  \
+{                                                               \
+    intptr_t i = simd_oprsz(desc);                              \
+    uint64_t *g = vg;                                           \
+    if (pred_all_active(g, i, ESZ)) {                           \
+        BATCH(vd, vn, vm, i / sizeof(TYPE), status);            \
+        return;                                                 \
+    }                                                           \
+    do {                                                        \
+        uint64_t pg = g[(i - 1) >> 6];                          \
+        do {                                                    \
+            i -= sizeof(TYPE);                                  \
+            if (likely((pg >> (i & 63)) & 1)) {                 \
+                TYPE nn = *(TYPE *)(vn + H(i));                 \
+                TYPE mm = *(TYPE *)(vm + H(i));                 \
+                *(TYPE *)(vd + H(i)) = OP(nn, mm, status);      \
+            }                                                   \
+        } while (i & 63);                                       \
+    } while (i != 0);                                           \
+}
+
 DO_ZPZZ_FP(sve_fadd_h, uint16_t, H1_2, float16_add)
-DO_ZPZZ_FP(sve_fadd_s, uint32_t, H1_4, float32_add)
-DO_ZPZZ_FP(sve_fadd_d, uint64_t, H1_8, float64_add)
+DO_ZPZZ_FP_BATCH(sve_fadd_s, uint32_t, MO_32, H1_4, float32_add,
+                 float32_add_batch)
+DO_ZPZZ_FP_BATCH(sve_fadd_d, uint64_t, MO_64, H1_8, float64_add,
+                 float64_add_batch)
 
 DO_ZPZZ_FP(sve_fsub_h, uint16_t, H1_2, float16_sub)
-DO_ZPZZ_FP(sve_fsub_s, uint32_t, H1_4, float32_sub)
-DO_ZPZZ_FP(sve_fsub_d, uint64_t, H1_8, float64_sub)
+DO_ZPZZ_FP_BATCH(sve_fsub_s, uint32_t, MO_32, H1_4, float32_sub,
+                 float32_sub_batch)
+DO_ZPZZ_FP_BATCH(sve_fsub_d, uint64_t, MO_64, H1_8, float64_sub,
+                 float64_sub_batch)
 
 DO_ZPZZ_FP(sve_fmul_h, uint16_t, H1_2, float16_mul)
-DO_ZPZZ_FP(sve_fmul_s, uint32_t, H1_4, float32_mul)
-DO_ZPZZ_FP(sve_fmul_d, uint64_t, H1_8, float64_mul)
+DO_ZPZZ_FP_BATCH(sve_fmul_s, uint32_t, MO_32, H1_4, float32_mul,
+                 float32_mul_batch)
+DO_ZPZZ_FP_BATCH(sve_fmul_d, uint64_t, MO_64, H1_8, float64_mul,
+                 float64_mul_batch)
 
 DO_ZPZZ_FP(sve_fdiv_h, uint16_t, H1_2, float16_div)
-DO_ZPZZ_FP(sve_fdiv_s, uint32_t, H1_4, float32_div)
-DO_ZPZZ_FP(sve_fdiv_d, uint64_t, H1_8, float64_div)
+DO_ZPZZ_FP_BATCH(sve_fdiv_s, uint32_t, MO_32, H1_4, float32_div,
+                 float32_div_batch)
+DO_ZPZZ_FP_BATCH(sve_fdiv_d, uint64_t, MO_64, H1_8, float64_div,
+                 float64_div_batch)
 
 DO_ZPZZ_FP(sve_fmin_h, uint16_t, H1_2, float16_min)
 DO_ZPZZ_FP(sve_fmin_s, uint32_t, H1_4, float32_min)
@@ -4381,6 +4436,7 @@ DO_ZPZZ_FP(sve_fmulx_s, uint32_t, H1_4, helper_vfp_mulxs)
 DO_ZPZZ_FP(sve_fmulx_d, uint64_t, H1_8, helper_vfp_mulxd)
 
 #undef DO_ZPZZ_FP
+#undef DO_ZPZZ_FP_BATCH
 
 /* Three-operand expander, with one scalar operand, controlled by
  * a predicate, with the extra float_status parameter.
@@ -23,6 +23,7 @@
 #include "disas/disas.h"
 #include "exec/exec-all.h"
 #include "tcg/tcg-op.h"
+#include "tcg/tcg-op-gvec.h"
 #include "exec/cpu_ldst.h"
 #include "exec/translator.h"
 
@@ -927,6 +928,7 @@ static CCPrepare gen_prepare_eflags_o(DisasContext *s, TCGv reg)
     case CC_OP_ADCOX:
         return (CCPrepare) { .cond = TCG_COND_NE, .reg = cpu_cc_src2,
                              .mask = -1, .no_setcond = true };
+    case CC_OP_LOGICB ... CC_OP_LOGICQ:
     case CC_OP_CLR:
     case CC_OP_POPCNT:
         return (CCPrepare) { .cond = TCG_COND_NEVER, .mask = -1 };
@@ -1007,6 +1009,31 @@ static CCPrepare gen_prepare_cc(DisasContext *s, int b, TCGv reg)
         }
         break;
 
+    case CC_OP_LOGICB ... CC_OP_LOGICQ:
+        /*
+         * CF and OF are clear, so the relational conditions depend only
+         * on the result and do not need to compute all of eflags.
+         */
+        size = s->cc_op - CC_OP_LOGICB;
+        switch (jcc_op) {
+        case JCC_BE:
+            cond = TCG_COND_EQ;
+            goto fast_jcc_logic;
+        case JCC_L:
+            cond = TCG_COND_LT;
+            goto fast_jcc_logic;
+        case JCC_LE:
+            cond = TCG_COND_LE;
+        fast_jcc_logic:
+            t0 = gen_ext_tl(reg, cpu_cc_dst, size, cond != TCG_COND_EQ);
+            cc = (CCPrepare) { .cond = cond, .reg = t0, .mask = -1 };
+            break;
+
+        default:
+            goto slow_jcc;
+        }
+        break;
+
     default:
     slow_jcc:
         /* This actually generates good code for JC, JZ and JS.  */
@@ -3125,6 +3152,114 @@ static const struct SSEOpHelper_eppi sse_op_table7[256] = {
     [0xdf] = AESNI_OP(aeskeygenassist),
 };
 
+/*
+ * Expand the simple MMX/SSE integer and logical operations with the
+ * generic vector infrastructure, so that they are emitted as host
+ * vector instructions instead of calls to the ops_sse.h helpers.
+ * @sz is 8 for MMX and 16 for SSE.  Return false if @b is not one
+ * of the operations handled here.
+ */
+static bool gen_sse_gvec(int b, uint32_t sz, int op1_offset, int op2_offset)
+{
+    uint32_t d, a, o;
+
+#ifdef HOST_WORDS_BIGENDIAN
+    /*
+     * The XMM lanes are the last 16 bytes of a ZMMReg, in reverse
+     * order; all operations below are lane-wise, so only the start
+     * of the vector has to be adjusted.
+     */
+    if (sz == 16) {
+        op1_offset += offsetof(ZMMReg, ZMM_Q(1));
+        op2_offset += offsetof(ZMMReg, ZMM_Q(1));
+    }
+#endif
+    d = a = op1_offset;
+    o = op2_offset;
+
+    switch (b) {
+    case 0x54: /* andps, andpd */
+    case 0xdb: /* pand */
+        tcg_gen_gvec_and(MO_64, d, a, o, sz, sz);
+        break;
+    case 0x55: /* andnps, andnpd */
+    case 0xdf: /* pandn */
+        tcg_gen_gvec_andc(MO_64, d, o, a, sz, sz);
+        break;
+    case 0x56: /* orps, orpd */
+    case 0xeb: /* por */
+        tcg_gen_gvec_or(MO_64, d, a, o, sz, sz);
+        break;
+    case 0x57: /* xorps, xorpd */
+    case 0xef: /* pxor */
+        tcg_gen_gvec_xor(MO_64, d, a, o, sz, sz);
+        break;
+
+    case 0xfc: /* paddb */
+    case 0xfd: /* paddw */
+    case 0xfe: /* paddl */
+        tcg_gen_gvec_add(b - 0xfc, d, a, o, sz, sz);
+        break;
+    case 0xd4: /* paddq */
+        tcg_gen_gvec_add(MO_64, d, a, o, sz, sz);
+        break;
+    case 0xf8: /* psubb */
+    case 0xf9: /* psubw */
+    case 0xfa: /* psubl */
+    case 0xfb: /* psubq */
+        tcg_gen_gvec_sub(b - 0xf8, d, a, o, sz, sz);
+        break;
+    case 0xd5: /* pmullw */
+        tcg_gen_gvec_mul(MO_16, d, a, o, sz, sz);
+        break;
+
+    case 0xec: /* paddsb */
+    case 0xed: /* paddsw */
+        tcg_gen_gvec_ssadd(b - 0xec, d, a, o, sz, sz);
+        break;
+    case 0xdc: /* paddusb */
+    case 0xdd: /* paddusw */
+        tcg_gen_gvec_usadd(b - 0xdc, d, a, o, sz, sz);
+        break;
+    case 0xe8: /* psubsb */
+    case 0xe9: /* psubsw */
+        tcg_gen_gvec_sssub(b - 0xe8, d, a, o, sz, sz);
+        break;
+    case 0xd8: /* psubusb */
+    case 0xd9: /* psubusw */
+        tcg_gen_gvec_ussub(b - 0xd8, d, a, o, sz, sz);
+        break;
+
+    case 0xda: /* pminub */
+        tcg_gen_gvec_umin(MO_8, d, a, o, sz, sz);
+        break;
+    case 0xde: /* pmaxub */
+        tcg_gen_gvec_umax(MO_8, d, a, o, sz, sz);
+        break;
+    case 0xea: /* pminsw */
+        tcg_gen_gvec_smin(MO_16, d, a, o, sz, sz);
+        break;
+    case 0xee: /* pmaxsw */
+        tcg_gen_gvec_smax(MO_16, d, a, o, sz, sz);
+        break;
+
+    case 0x74: /* pcmpeqb */
+    case 0x75: /* pcmpeqw */
+    case 0x76: /* pcmpeql */
+        tcg_gen_gvec_cmp(TCG_COND_EQ, b - 0x74, d, a, o, sz, sz);
+        break;
+    case 0x64: /* pcmpgtb */
+    case 0x65: /* pcmpgtw */
+    case 0x66: /* pcmpgtl */
+        tcg_gen_gvec_cmp(TCG_COND_GT, b - 0x64, d, a, o, sz, sz);
+        break;
+
+    default:
+        return false;
+    }
+    return true;
+}
+
 static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                     target_ulong pc_start)
 {
@@ -4560,6 +4695,9 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             sse_fn_eppt(cpu_env, s->ptr0, s->ptr1, s->A0);
             break;
         default:
+            if (gen_sse_gvec(b, is_xmm ? 16 : 8, op1_offset, op2_offset)) {
+                break;
+            }
             tcg_gen_addi_ptr(s->ptr0, cpu_env, op1_offset);
             tcg_gen_addi_ptr(s->ptr1, cpu_env, op2_offset);
             sse_fn_epp(cpu_env, s->ptr0, s->ptr1);
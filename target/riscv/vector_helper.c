@@ -3198,12 +3198,51 @@ void HELPER(NAME)(void *vd, void *v0, void *vs1,          \
     CLEAR_FN(vd, vl, vl * DSZ,  vlmax * DSZ);             \
 }
 
+/*
+ * Unmasked operations on elements 0..vl-1 can use the softfloat batch
+ * functions.  On big-endian hosts, H4() swaps 32-bit elements within
+ * each 64-bit chunk, so this is only true for an even vl.
+ */
+static inline bool vext_fp_batch_ok(uint32_t vm, uint32_t vl, uint32_t esz)
+{
+#ifdef HOST_WORDS_BIGENDIAN
+    if (esz == 4 && (vl & 1)) {
+        return false;
+    }
+#endif
+    return vm;
+}
+
+#define GEN_VEXT_VV_ENV_BATCH(NAME, ESZ, DSZ, CLEAR_FN, BATCH) \
+void HELPER(NAME)(void *vd, void *v0, void *vs1,          \
+                  void *vs2, CPURISCVState *env,          \
+                  uint32_t desc)                          \
+{                                                         \
+    uint32_t vlmax = vext_maxsz(desc) / ESZ;              \
+    uint32_t mlen = vext_mlen(desc);                      \
+    uint32_t vm = vext_vm(desc);                          \
+    uint32_t vl = env->vl;                                \
+    uint32_t i;                                           \
+                                                          \
+    if (vext_fp_batch_ok(vm, vl, ESZ)) {                  \
+        BATCH(vd, vs2, vs1, vl, &env->fp_status);         \
+    } else {                                              \
+        for (i = 0; i < vl; i++) {                        \
+            if (!vm && !vext_elem_mask(v0, mlen, i)) {    \
+                continue;                                 \
+            }                                             \
+            do_##NAME(vd, vs1, vs2, i, env);              \
+        }                                                 \
+    }                                                     \
+    CLEAR_FN(vd, vl, vl * DSZ,  vlmax * DSZ);             \
+}
+
 RVVCALL(OPFVV2, vfadd_vv_h, OP_UUU_H, H2, H2, H2, float16_add)
 RVVCALL(OPFVV2, vfadd_vv_w, OP_UUU_W, H4, H4, H4, float32_add)
 RVVCALL(OPFVV2, vfadd_vv_d, OP_UUU_D, H8, H8, H8, float64_add)
 GEN_VEXT_VV_ENV(vfadd_vv_h, 2, 2, clearh)
-GEN_VEXT_VV_ENV(vfadd_vv_w, 4, 4, clearl)
-GEN_VEXT_VV_ENV(vfadd_vv_d, 8, 8, clearq)
+GEN_VEXT_VV_ENV_BATCH(vfadd_vv_w, 4, 4, clearl, float32_add_batch)
+GEN_VEXT_VV_ENV_BATCH(vfadd_vv_d, 8, 8, clearq, float64_add_batch)
 
 #define OPFVF2(NAME, TD, T1, T2, TX1, TX2, HD, HS2, OP)        \
 static void do_##NAME(void *vd, uint64_t s1, void *vs2, int i, \
@@ -3244,8 +3283,8 @@ RVVCALL(OPFVV2, vfsub_vv_h, OP_UUU_H, H2, H2, H2, float16_sub)
 RVVCALL(OPFVV2, vfsub_vv_w, OP_UUU_W, H4, H4, H4, float32_sub)
 RVVCALL(OPFVV2, vfsub_vv_d, OP_UUU_D, H8, H8, H8, float64_sub)
 GEN_VEXT_VV_ENV(vfsub_vv_h, 2, 2, clearh)
-GEN_VEXT_VV_ENV(vfsub_vv_w, 4, 4, clearl)
-GEN_VEXT_VV_ENV(vfsub_vv_d, 8, 8, clearq)
+GEN_VEXT_VV_ENV_BATCH(vfsub_vv_w, 4, 4, clearl, float32_sub_batch)
+GEN_VEXT_VV_ENV_BATCH(vfsub_vv_d, 8, 8, clearq, float64_sub_batch)
 RVVCALL(OPFVF2, vfsub_vf_h, OP_UUU_H, H2, H2, float16_sub)
 RVVCALL(OPFVF2, vfsub_vf_w, OP_UUU_W, H4, H4, float32_sub)
 RVVCALL(OPFVF2, vfsub_vf_d, OP_UUU_D, H8, H8, float64_sub)
@@ -3363,8 +3402,8 @@ RVVCALL(OPFVV2, vfmul_vv_h, OP_UUU_H, H2, H2, H2, float16_mul)
 RVVCALL(OPFVV2, vfmul_vv_w, OP_UUU_W, H4, H4, H4, float32_mul)
 RVVCALL(OPFVV2, vfmul_vv_d, OP_UUU_D, H8, H8, H8, float64_mul)
 GEN_VEXT_VV_ENV(vfmul_vv_h, 2, 2, clearh)
-GEN_VEXT_VV_ENV(vfmul_vv_w, 4, 4, clearl)
-GEN_VEXT_VV_ENV(vfmul_vv_d, 8, 8, clearq)
+GEN_VEXT_VV_ENV_BATCH(vfmul_vv_w, 4, 4, clearl, float32_mul_batch)
+GEN_VEXT_VV_ENV_BATCH(vfmul_vv_d, 8, 8, clearq, float64_mul_batch)
 RVVCALL(OPFVF2, vfmul_vf_h, OP_UUU_H, H2, H2, float16_mul)
 RVVCALL(OPFVF2, vfmul_vf_w, OP_UUU_W, H4, H4, float32_mul)
 RVVCALL(OPFVF2, vfmul_vf_d, OP_UUU_D, H8, H8, float64_mul)
@@ -3376,8 +3415,8 @@ RVVCALL(OPFVV2, vfdiv_vv_h, OP_UUU_H, H2, H2, H2, float16_div)
 RVVCALL(OPFVV2, vfdiv_vv_w, OP_UUU_W, H4, H4, H4, float32_div)
 RVVCALL(OPFVV2, vfdiv_vv_d, OP_UUU_D, H8, H8, H8, float64_div)
 GEN_VEXT_VV_ENV(vfdiv_vv_h, 2, 2, clearh)
-GEN_VEXT_VV_ENV(vfdiv_vv_w, 4, 4, clearl)
-GEN_VEXT_VV_ENV(vfdiv_vv_d, 8, 8, clearq)
+GEN_VEXT_VV_ENV_BATCH(vfdiv_vv_w, 4, 4, clearl, float32_div_batch)
+GEN_VEXT_VV_ENV_BATCH(vfdiv_vv_d, 8, 8, clearq, float64_div_batch)
 RVVCALL(OPFVF2, vfdiv_vf_h, OP_UUU_H, H2, H2, float16_div)
 RVVCALL(OPFVF2, vfdiv_vf_w, OP_UUU_W, H4, H4, float32_div)
 RVVCALL(OPFVF2, vfdiv_vf_d, OP_UUU_D, H8, H8, float64_div)
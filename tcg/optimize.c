@@ -598,12 +598,200 @@ static bool swap_commutative2(TCGArg *p1, TCGArg *p2)
     return false;
 }
 
+/*
+ * Forward values loaded from or stored to env within a basic block.
+ *
+ * Frontends often reload the same CPU state field several times per
+ * instruction, or read back a field they have just written.  Within a
+ * basic block, and as long as no helper can have changed it, the field
+ * still holds the value of the temp we last loaded it into or stored
+ * it from, so the later load can become a move, which tcg_optimize()
+ * then propagates away.
+ */
+
+#define ENV_FWD_SLOTS  32
+
+typedef struct EnvFwdSlot {
+    TCGOpcode ld_opc;       /* load that would read the field back */
+    intptr_t ofs;
+    int size;
+    TCGTemp *ts;            /* temp holding the value of the field */
+} EnvFwdSlot;
+
+/* Size in bytes of the env memory accessed by a load or store.  */
+static int env_fwd_size(TCGOpcode opc)
+{
+    switch (opc) {
+    case INDEX_op_ld8u_i32:
+    case INDEX_op_ld8s_i32:
+    case INDEX_op_st8_i32:
+    case INDEX_op_ld8u_i64:
+    case INDEX_op_ld8s_i64:
+    case INDEX_op_st8_i64:
+        return 1;
+    case INDEX_op_ld16u_i32:
+    case INDEX_op_ld16s_i32:
+    case INDEX_op_st16_i32:
+    case INDEX_op_ld16u_i64:
+    case INDEX_op_ld16s_i64:
+    case INDEX_op_st16_i64:
+        return 2;
+    case INDEX_op_ld_i32:
+    case INDEX_op_st_i32:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_ld32s_i64:
+    case INDEX_op_st32_i64:
+        return 4;
+    case INDEX_op_ld_i64:
+    case INDEX_op_st_i64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+void tcg_optimize_env_loads(TCGContext *s)
+{
+    EnvFwdSlot slots[ENV_FWD_SLOTS];
+    TCGTemp *env = tcgv_ptr_temp(cpu_env);
+    TCGOp *op, *op_next;
+    int nb_slots = 0, next_slot = 0;
+    size_t removed = 0;
+    int i;
+
+    QTAILQ_FOREACH_SAFE(op, &s->ops, link, op_next) {
+        TCGOpcode opc = op->opc;
+        const TCGOpDef *def = &tcg_op_defs[opc];
+        int size = env_fwd_size(opc);
+        bool is_store = def->nb_oargs == 0;
+
+        /*
+         * Helpers may write any part of env, barriers may make changes
+         * from other threads visible, and we cannot see into other
+         * blocks.  Start over after each of these.
+         */
+        if (opc == INDEX_op_call || opc == INDEX_op_mb ||
+            (def->flags & TCG_OPF_BB_END)) {
+            nb_slots = 0;
+            continue;
+        }
+
+        if (size && arg_temp(op->args[1]) != env) {
+            if (is_store) {
+                /* The pointer may well point into env.  */
+                nb_slots = 0;
+                continue;
+            }
+            size = 0;
+        }
+        if (opc == INDEX_op_st_vec) {
+            if (arg_temp(op->args[1]) != env) {
+                nb_slots = 0;
+                continue;
+            }
+            size = 8 << TCGOP_VECL(op);
+            is_store = true;
+        }
+
+        if (size && !is_store) {
+            intptr_t ofs = op->args[2];
+            TCGTemp *out = arg_temp(op->args[0]);
+
+            for (i = 0; i < nb_slots; i++) {
+                if (slots[i].ld_opc == opc && slots[i].ofs == ofs) {
+                    break;
+                }
+            }
+            if (i < nb_slots) {
+                TCGTemp *ts = slots[i].ts;
+
+                removed++;
+                if (ts == out) {
+                    tcg_op_remove(s, op);
+                    continue;
+                }
+                op->opc = opc = (def->flags & TCG_OPF_64BIT
+                                 ? INDEX_op_mov_i64 : INDEX_op_mov_i32);
+                op->args[1] = temp_arg(ts);
+                size = 0;
+            }
+        }
+
+        if (is_store && size) {
+            intptr_t ofs = op->args[2];
+
+            /* Forget any field the store overlaps.  */
+            for (i = 0; i < nb_slots; ) {
+                if (slots[i].ofs < ofs + size &&
+                    ofs < slots[i].ofs + slots[i].size) {
+                    slots[i] = slots[--nb_slots];
+                } else {
+                    i++;
+                }
+            }
+        } else {
+            /* Forget any field cached in a temp this op overwrites.  */
+            int j;
+            for (j = 0; j < def->nb_oargs; j++) {
+                TCGTemp *out = arg_temp(op->args[j]);
+                for (i = 0; i < nb_slots; ) {
+                    if (slots[i].ts == out) {
+                        slots[i] = slots[--nb_slots];
+                    } else {
+                        i++;
+                    }
+                }
+            }
+        }
+
+        /* Remember the field: only full width stores can be read back.  */
+        switch (opc) {
+        case INDEX_op_st_i32:
+        case INDEX_op_st_i64:
+        case INDEX_op_ld8u_i32:
+        case INDEX_op_ld8s_i32:
+        case INDEX_op_ld16u_i32:
+        case INDEX_op_ld16s_i32:
+        case INDEX_op_ld_i32:
+        case INDEX_op_ld8u_i64:
+        case INDEX_op_ld8s_i64:
+        case INDEX_op_ld16u_i64:
+        case INDEX_op_ld16s_i64:
+        case INDEX_op_ld32u_i64:
+        case INDEX_op_ld32s_i64:
+        case INDEX_op_ld_i64:
+            if (size == 0) {
+                break;
+            }
+            if (nb_slots < ENV_FWD_SLOTS) {
+                i = nb_slots++;
+            } else {
+                i = next_slot;
+                next_slot = (next_slot + 1) % ENV_FWD_SLOTS;
+            }
+            slots[i].ld_opc = (opc == INDEX_op_st_i32 ? INDEX_op_ld_i32
+                               : opc == INDEX_op_st_i64 ? INDEX_op_ld_i64
+                               : opc);
+            slots[i].ofs = op->args[2];
+            slots[i].size = size;
+            slots[i].ts = arg_temp(op->args[0]);
+            break;
+        default:
+            break;
+        }
+    }
+
+    qatomic_set(&s->env_fwd_ops, s->env_fwd_ops + removed);
+    qatomic_set(&s->env_fwd_tbs, s->env_fwd_tbs + 1);
+}
+
 /* Propagate constants and copies, fold constant expressions. */
 void tcg_optimize(TCGContext *s)
 {
     int nb_temps, nb_globals, i;
     TCGOp *op, *op_next, *prev_mb = NULL;
     TCGTempSet temps_used;
+    TCGBar mo_done = 0;
 
     /* Array VALS has an element for each temp.
        If this temp holds a constant then its value is kept in VALS' element.
@@ -624,6 +812,32 @@ void tcg_optimize(TCGContext *s)
         TCGOpcode opc = op->opc;
         const TCGOpDef *def = &tcg_op_defs[opc];
 
+        /*
+         * Track in mo_done the orderings that earlier barriers still
+         * guarantee: a TCG_MO_X_Y bit stays set until the next access
+         * of type X, which the earlier barrier did not order.
+         */
+        switch (opc) {
+        case INDEX_op_qemu_ld_i32:
+        case INDEX_op_qemu_ld_i64:
+            mo_done &= ~(TCG_MO_LD_LD | TCG_MO_LD_ST);
+            break;
+        case INDEX_op_qemu_st_i32:
+        case INDEX_op_qemu_st8_i32:
+        case INDEX_op_qemu_st_i64:
+            mo_done &= ~(TCG_MO_ST_LD | TCG_MO_ST_ST);
+            break;
+        case INDEX_op_call:
+            /* Helpers may access guest memory in any way.  */
+            mo_done = 0;
+            break;
+        default:
+            if (def->flags & TCG_OPF_BB_END) {
+                mo_done = 0;
+            }
+            break;
+        }
+
         /* Count the arguments, and initialize the temps that are
            going to be used */
         if (opc == INDEX_op_call) {
@@ -1515,6 +1729,23 @@ void tcg_optimize(TCGContext *s)
             break;
         }
 
+        /*
+         * Drop the parts of a barrier that an earlier barrier in the
+         * same block already provides, e.g. the LD_LD of the second
+         * barrier in "mb all; st; mb all" when no load came between.
+         */
+        if (opc == INDEX_op_mb && (op->args[0] & TCG_MO_ALL)) {
+            TCGBar bar = op->args[0];
+            TCGBar need = bar & TCG_MO_ALL & ~mo_done;
+
+            mo_done |= bar & TCG_MO_ALL;
+            if (need == 0) {
+                tcg_op_remove(s, op);
+                continue;
+            }
+            op->args[0] = need | (bar & ~TCG_MO_ALL);
+        }
+
         /* Eliminate duplicate and redundant fence instructions.  */
         if (prev_mb) {
             switch (opc) {
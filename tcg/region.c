@@ -24,6 +24,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/units.h"
+#include "qemu/bitmap.h"
 #include "qapi/error.h"
 #include "exec/exec-all.h"
 #include "tcg/tcg.h"
@@ -56,6 +57,9 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    size_t evict_next; /* where to start looking for a region to evict */
+    unsigned long *full; /* regions filled up and released by their context */
+    unsigned long *evicted; /* regions emptied by eviction, ready for reuse */
 };
 
 static struct tcg_region_state region;
@@ -157,10 +161,23 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* Return the index of the region containing @p, a pointer into the rw buffer */
+static size_t tcg_region_index(const void *p)
 {
-    size_t region_idx;
+    ptrdiff_t offset;
+
+    if (p < region.start_aligned) {
+        return 0;
+    }
+    offset = p - region.start_aligned;
+    if (offset > region.stride * (region.n - 1)) {
+        return region.n - 1;
+    }
+    return offset / region.stride;
+}
 
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -171,19 +188,7 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
             return NULL;
         }
     }
-
-    if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
-    }
-    return region_trees + region_idx * tree_size;
+    return region_trees + tcg_region_index(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -335,7 +340,15 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
     if (region.current == region.n) {
-        return true;
+        /* All regions have been handed out; reuse an evicted one if any. */
+        size_t i = find_first_bit(region.evicted, region.n);
+
+        if (i == region.n) {
+            return true;
+        }
+        clear_bit(i, region.evicted);
+        tcg_region_assign(s, i);
+        return false;
     }
     tcg_region_assign(s, region.current);
     region.current++;
@@ -351,11 +364,13 @@ bool tcg_region_alloc(TCGContext *s)
     bool err;
     /* read the region size now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    size_t idx_full = tcg_region_index(s->code_gen_buffer);
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
+        set_bit(idx_full, region.full);
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -387,6 +402,9 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.evict_next = 0;
+    bitmap_zero(region.full, region.n);
+    bitmap_zero(region.evicted, region.n);
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -397,6 +415,72 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+static gboolean tcg_region_tree_collect(gpointer k, gpointer v, gpointer data)
+{
+    g_ptr_array_add(data, v);
+    return FALSE;
+}
+
+/*
+ * Empty the oldest full region, invalidating the TBs it contains, so that
+ * a TCG context that ran out of space can continue without a tb_flush.
+ * Regions are evicted in the order in which they were handed out, which
+ * spares the translations of the regions that were filled most recently.
+ * Returns false if there is no full region to evict.
+ *
+ * Call from a safe-work context.
+ */
+bool tcg_region_evict(void)
+{
+    struct tcg_region_tree *rt;
+    GPtrArray *tbs;
+    void *start, *end;
+    size_t i;
+
+    qemu_mutex_lock(&region.lock);
+    i = find_next_bit(region.full, region.n, region.evict_next);
+    if (i == region.n) {
+        i = find_first_bit(region.full, region.n);
+        if (i == region.n) {
+            qemu_mutex_unlock(&region.lock);
+            return false;
+        }
+    }
+    clear_bit(i, region.full);
+    region.evict_next = i + 1;
+    tcg_region_bounds(i, &start, &end);
+    region.agg_size_full -= end - start - TCG_HIGHWATER;
+    qemu_mutex_unlock(&region.lock);
+
+    /*
+     * No context allocates from a full region, so its tree cannot grow.
+     * Invalidate the TBs without holding the tree lock, since
+     * tb_phys_invalidate takes the page locks.
+     */
+    rt = region_trees + i * tree_size;
+    tbs = g_ptr_array_new();
+    qemu_mutex_lock(&rt->lock);
+    g_tree_foreach(rt->tree, tcg_region_tree_collect, tbs);
+    qemu_mutex_unlock(&rt->lock);
+
+    for (guint j = 0; j < tbs->len; j++) {
+        tb_phys_invalidate(g_ptr_array_index(tbs, j), -1);
+    }
+    g_ptr_array_free(tbs, true);
+
+    qemu_mutex_lock(&rt->lock);
+    g_tree_foreach(rt->tree, tcg_region_tree_traverse, NULL);
+    /* Increment the refcount first so that destroy acts as a reset */
+    g_tree_ref(rt->tree);
+    g_tree_destroy(rt->tree);
+    qemu_mutex_unlock(&rt->lock);
+
+    qemu_mutex_lock(&region.lock);
+    set_bit(i, region.evicted);
+    qemu_mutex_unlock(&region.lock);
+    return true;
+}
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
 {
 #ifdef CONFIG_USER_ONLY
@@ -876,6 +960,8 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
 
     /* init the region struct */
     qemu_mutex_init(&region.lock);
+    region.full = bitmap_new(region.n);
+    region.evicted = bitmap_new(region.n);
 
     /*
      * Set guard pages in the rw buffer, as that's the one into which
@@ -997,3 +1083,19 @@ size_t tcg_tb_phys_invalidate_count(void)
     }
     return total;
 }
+
+void tcg_env_forward_counts(size_t *pops, size_t *ptbs)
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    unsigned int i;
+    size_t ops = 0, tbs = 0;
+
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+
+        ops += qatomic_read(&s->env_fwd_ops);
+        tbs += qatomic_read(&s->env_fwd_tbs);
+    }
+    *pops = ops;
+    *ptbs = tbs;
+}
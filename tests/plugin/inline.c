@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2026 QEMU contributors
+ *
+ * Cross-check per-vCPU inline ops and conditional callbacks against
+ * plain callbacks: every event is counted once by generated code and
+ * once from a regular callback. Regular callbacks are emitted before
+ * the inline ops and conditional callbacks of the same event, so each
+ * one can check that the counts of its own vCPU agree so far; other
+ * vCPUs may still be running at exit, so the totals are only printed.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+typedef struct {
+    uint64_t tb_inline;
+    uint64_t tb_cb;
+    uint64_t tb_cond;
+    uint64_t tb_mark;
+    uint64_t insn_inline;
+    uint64_t insn_cb;
+    uint64_t insn_cond;
+    uint64_t mem_inline;
+    uint64_t mem_cb;
+} CPUCount;
+
+static struct qemu_plugin_scoreboard *counts;
+static qemu_plugin_u64 tb_inline;
+static qemu_plugin_u64 tb_cb;
+static qemu_plugin_u64 tb_cond;
+static qemu_plugin_u64 tb_mark;
+static qemu_plugin_u64 insn_inline;
+static qemu_plugin_u64 insn_cb;
+static qemu_plugin_u64 insn_cond;
+static qemu_plugin_u64 mem_inline;
+static qemu_plugin_u64 mem_cb;
+
+static void vcpu_tb_exec(unsigned int cpu_index, void *udata)
+{
+    uint64_t count = qemu_plugin_u64_get(tb_cb, cpu_index);
+
+    g_assert(qemu_plugin_u64_get(tb_inline, cpu_index) == count);
+    g_assert(qemu_plugin_u64_get(tb_cond, cpu_index) == count);
+    qemu_plugin_u64_set(tb_cb, cpu_index, count + 1);
+    /* the inline store must set it back before the condition is tested */
+    qemu_plugin_u64_set(tb_mark, cpu_index, 0);
+}
+
+static void vcpu_tb_cond(unsigned int cpu_index, void *udata)
+{
+    g_assert(qemu_plugin_u64_get(tb_mark, cpu_index) == 1);
+    qemu_plugin_u64_add(tb_cond, cpu_index, 1);
+}
+
+static void vcpu_never(unsigned int cpu_index, void *udata)
+{
+    g_assert_not_reached();
+}
+
+static void vcpu_insn_exec(unsigned int cpu_index, void *udata)
+{
+    uint64_t count = qemu_plugin_u64_get(insn_cb, cpu_index);
+
+    g_assert(qemu_plugin_u64_get(insn_inline, cpu_index) == count);
+    g_assert(qemu_plugin_u64_get(insn_cond, cpu_index) == count);
+    qemu_plugin_u64_set(insn_cb, cpu_index, count + 1);
+}
+
+static void vcpu_insn_cond(unsigned int cpu_index, void *udata)
+{
+    qemu_plugin_u64_add(insn_cond, cpu_index, 1);
+}
+
+static void vcpu_mem(unsigned int cpu_index, qemu_plugin_meminfo_t info,
+                     uint64_t vaddr, void *udata)
+{
+    uint64_t count = qemu_plugin_u64_get(mem_cb, cpu_index);
+
+    g_assert(qemu_plugin_u64_get(mem_inline, cpu_index) == count);
+    qemu_plugin_u64_set(mem_cb, cpu_index, count + 1);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    size_t n = qemu_plugin_tb_n_insns(tb);
+    size_t i;
+
+    qemu_plugin_register_vcpu_tb_exec_cb(tb, vcpu_tb_exec,
+                                         QEMU_PLUGIN_CB_NO_REGS, NULL);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, tb_inline, 1);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_STORE_U64, tb_mark, 1);
+    qemu_plugin_register_vcpu_tb_exec_cond_cb(
+        tb, vcpu_tb_cond, QEMU_PLUGIN_CB_NO_REGS,
+        QEMU_PLUGIN_COND_EQ, tb_mark, 1, NULL);
+    qemu_plugin_register_vcpu_tb_exec_cond_cb(
+        tb, vcpu_never, QEMU_PLUGIN_CB_NO_REGS,
+        QEMU_PLUGIN_COND_NEVER, tb_mark, 0, NULL);
+
+    for (i = 0; i < n; i++) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+
+        qemu_plugin_register_vcpu_insn_exec_cb(insn, vcpu_insn_exec,
+                                               QEMU_PLUGIN_CB_NO_REGS, NULL);
+        qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+            insn, QEMU_PLUGIN_INLINE_ADD_U64, insn_inline, 1);
+        /* the comparison is unsigned, so this always holds */
+        qemu_plugin_register_vcpu_insn_exec_cond_cb(
+            insn, vcpu_insn_cond, QEMU_PLUGIN_CB_NO_REGS,
+            QEMU_PLUGIN_COND_LT, insn_inline, UINT64_MAX, NULL);
+        qemu_plugin_register_vcpu_insn_exec_cond_cb(
+            insn, vcpu_never, QEMU_PLUGIN_CB_NO_REGS,
+            QEMU_PLUGIN_COND_GT, insn_inline, UINT64_MAX, NULL);
+
+        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem,
+                                         QEMU_PLUGIN_CB_NO_REGS,
+                                         QEMU_PLUGIN_MEM_RW, NULL);
+        qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+            insn, QEMU_PLUGIN_MEM_RW, QEMU_PLUGIN_INLINE_ADD_U64,
+            mem_inline, 1);
+    }
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) out = g_string_new("");
+
+    g_string_printf(out, "tb exec: %" PRIu64 " inline, %" PRIu64
+                    " callback, %" PRIu64 " conditional\n",
+                    qemu_plugin_u64_sum(tb_inline),
+                    qemu_plugin_u64_sum(tb_cb),
+                    qemu_plugin_u64_sum(tb_cond));
+    g_string_append_printf(out, "insn exec: %" PRIu64 " inline, %" PRIu64
+                           " callback, %" PRIu64 " conditional\n",
+                           qemu_plugin_u64_sum(insn_inline),
+                           qemu_plugin_u64_sum(insn_cb),
+                           qemu_plugin_u64_sum(insn_cond));
+    g_string_append_printf(out, "mem accesses: %" PRIu64 " inline, %" PRIu64
+                           " callback\n",
+                           qemu_plugin_u64_sum(mem_inline),
+                           qemu_plugin_u64_sum(mem_cb));
+    qemu_plugin_outs(out->str);
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    counts = qemu_plugin_scoreboard_new(sizeof(CPUCount));
+    tb_inline = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount,
+                                                     tb_inline);
+    tb_cb = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount, tb_cb);
+    tb_cond = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount, tb_cond);
+    tb_mark = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount, tb_mark);
+    insn_inline = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount,
+                                                       insn_inline);
+    insn_cb = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount, insn_cb);
+    insn_cond = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount,
+                                                     insn_cond);
+    mem_inline = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount,
+                                                      mem_inline);
+    mem_cb = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount, mem_cb);
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}